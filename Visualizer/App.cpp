@@ -18,7 +18,7 @@ bool App::OnInit() {
 #endif
 
 	MainFrame* mainFrame = new MainFrame("GamePad");
-	mainFrame->SetSize(310, 280);
+	mainFrame->SetSize(310, 430);
 	mainFrame->Centre();
 	mainFrame->Show(true);
 	return true;
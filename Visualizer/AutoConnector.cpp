@@ -0,0 +1,118 @@
+﻿#include "AutoConnector.h"
+#include "SerialUtils.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+
+AutoConnector::AutoConnector(std::function<void(SerialAnalizer*)> onConnected, const SerialTuning::Options& tuning, bool includePseudo)
+	: onConnected(onConnected), tuning(tuning), includePseudo(includePseudo) {
+	worker = std::thread(&AutoConnector::Run, this);
+}
+
+AutoConnector::~AutoConnector() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		running = false;
+	}
+	cv.notify_all();
+	if (worker.joinable()) worker.join();
+}
+
+void AutoConnector::Disconnected() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		searching = true;
+		wake = true;
+	}
+	cv.notify_all();
+}
+
+void AutoConnector::Rescan() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		wake = true;
+	}
+	cv.notify_all();
+}
+
+void AutoConnector::Run() {
+	auto backoff = minBackoff;
+
+	std::unique_lock<std::mutex> lock(mtx);
+	while (running) {
+		// 接続中は切断通知まで、探索中はバックオフ時間か Rescan まで待つ
+		if (!searching) {
+			cv.wait(lock, [this] { return !running || searching; });
+			continue;
+		}
+		if (!wake) {
+			cv.wait_for(lock, backoff, [this] { return !running || wake; });
+			if (!running) break;
+		}
+		bool woken = wake;
+		wake = false;
+
+		lock.unlock();
+		SerialAnalizer* serial = TryConnect();
+		lock.lock();
+
+		if (serial) {
+			searching = false;
+			backoff = minBackoff;
+			lock.unlock();
+			onConnected(serial);
+			lock.lock();
+		}
+		else if (!woken) {
+			backoff = std::min(backoff * 2, maxBackoff);
+		}
+	}
+}
+
+SerialAnalizer* AutoConnector::TryConnect() {
+	std::vector<std::string> candidates;
+	for (const auto& p : SerialUtils::AvailablePorts()) {
+		if (p.pseudo && !includePseudo) continue;
+		candidates.push_back(p.port);
+	}
+	if (candidates.empty()) return nullptr;
+
+	// 全ポートを同時にプローブし、最初に成功したポートを採用する
+	// プローブで開いたポートをそのまま使うので、開き直しやニュートラルの再計算は行わない
+	std::mutex probeMtx;
+	std::condition_variable probeCv;
+	SerialAnalizer* serial = nullptr;
+	std::string port;
+	size_t finished = 0;
+
+	std::vector<std::thread> probes;
+	for (const auto& candidate : candidates) {
+		probes.emplace_back([&, candidate] {
+			SerialAnalizer* probed = SerialAnalizer::Probe(candidate, probeTimeoutMs, tuning);
+			std::lock_guard<std::mutex> lock(probeMtx);
+			if (probed && !serial) {
+				serial = probed;
+				port = candidate;
+			}
+			else {
+				delete probed;
+			}
+			++finished;
+			probeCv.notify_all();
+		});
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(probeMtx);
+		probeCv.wait(lock, [&] { return serial || finished == candidates.size(); });
+		// 残りのプローブは別ポートなので、終了を待たずに読み込みを始めてよい
+		if (serial) {
+			serial->Start();
+			std::cout << "Auto connected: " << port << std::endl;
+		}
+	}
+
+	for (auto& t : probes) t.join();
+	return serial;
+}
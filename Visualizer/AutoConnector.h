@@ -0,0 +1,42 @@
+﻿#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "SerialAnalizer.h"
+
+// 全ポートを並列にプローブし、最初にフレームを返したポートへ接続する
+// 切断後はバックオフしながらバックグラウンドで探し続ける
+class AutoConnector
+{
+public:
+	// onConnected は探索スレッドから呼ばれる。受け取った SerialAnalizer の所有権は呼び出し側に移る
+	AutoConnector(std::function<void(SerialAnalizer*)> onConnected, const SerialTuning::Options& tuning = {}, bool includePseudo = false);
+	~AutoConnector();
+
+	// 接続中の SerialAnalizer が止まったら呼ぶ。探索を再開する
+	void Disconnected();
+	// ポートが増減したときに呼ぶ。バックオフ待ちを打ち切ってすぐに探す
+	void Rescan();
+
+private:
+	void Run();
+	SerialAnalizer* TryConnect();
+
+	static constexpr int probeTimeoutMs = 250; // ニュートラル用の20レポート (8ms周期で160ms) が揃う長さ
+	static constexpr auto minBackoff = std::chrono::milliseconds(100);
+	static constexpr auto maxBackoff = std::chrono::milliseconds(1000);
+
+	std::function<void(SerialAnalizer*)> onConnected;
+	SerialTuning::Options tuning;
+	bool includePseudo;
+
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool running = true;
+	bool searching = true;
+	bool wake = true;
+	std::thread worker;
+};
@@ -0,0 +1,114 @@
+﻿#include "DeviceClock.h"
+#include <algorithm>
+#include <cmath>
+
+
+void DeviceClock::Reset() {
+	head = 0;
+	count = 0;
+	started = false;
+	ticks = 0;
+	period = 0;
+	offset = 0;
+	sinceFit = 0;
+	valid = false;
+	lastOut = 0;
+	slew = 0;
+}
+
+DeviceClock::Clock::time_point DeviceClock::Update(uint8_t timer, Clock::time_point arrival) {
+	if (!started) {
+		started = true;
+		origin = arrival;
+		lastTimer = timer;
+		lastHost = 0;
+	}
+
+	double host = std::chrono::duration<double>(arrival - origin).count();
+
+	// タイマーの巻き戻りを展開する
+	// 長く途切れた場合は推定周期から何周したかを補う
+	uint64_t delta = (uint8_t)(timer - lastTimer);
+	if (Locked()) {
+		double expected = (host - lastHost) / period;
+		if (expected - delta >= 192) {
+			delta += 256 * (uint64_t)std::llround((expected - delta) / 256);
+		}
+	}
+	ticks += delta;
+	lastTimer = timer;
+	lastHost = host;
+
+	window[head] = { (double)ticks, host };
+	head = (head + 1) % windowSize;
+	if (count < windowSize) ++count;
+
+	if (count < minPoints) return Output(host, arrival);
+
+	// 当てはめ直しは数サンプルおき。間は切片 (下側包絡線) だけを更新する
+	if (sinceFit == 0 || ++sinceFit >= fitInterval) {
+		Fit();
+		sinceFit = 1;
+	}
+	else if (valid) {
+		offset = std::min(offset, host - period * (double)ticks);
+	}
+	if (!valid) return Output(host, arrival);
+	return Output(offset + period * (double)ticks, arrival);
+}
+
+DeviceClock::Clock::time_point DeviceClock::Output(double target, Clock::time_point arrival) {
+	const double host = std::chrono::duration<double>(arrival - origin).count();
+	// 推定開始時や当てはめ直しで目標が過去に飛んだら、差を slew で埋めて徐々に目標へ寄せる
+	if (target + slew < lastOut) slew = lastOut - target;
+	// 補正後の時刻は受信時刻より後にはならず、前回より前にも戻らない
+	double captured = std::max(std::min(target + slew, host), lastOut);
+	slew *= slewDecay;
+	lastOut = captured;
+	if (captured >= host) return arrival; // 変換の丸めで受信時刻を越えないように
+	return origin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(captured));
+}
+
+void DeviceClock::Fit() {
+	// 窓内の点を時系列順に並べ、下側凸包を求める (tick は単調増加)
+	std::array<Point, windowSize> hull;
+	size_t n = 0;
+	double meanTick = 0;
+	const size_t first = (head + windowSize - count) % windowSize;
+
+	for (size_t i = 0; i < count; ++i) {
+		const Point& p = window[(first + i) % windowSize];
+		meanTick += p.tick;
+
+		if (n > 0 && hull[n - 1].tick == p.tick) {
+			if (p.host >= hull[n - 1].host) continue;
+			--n;
+		}
+		while (n >= 2) {
+			const Point& o = hull[n - 2];
+			const Point& a = hull[n - 1];
+			double cross = (a.tick - o.tick) * (p.host - o.host) - (a.host - o.host) * (p.tick - o.tick);
+			if (cross > 0) break;
+			--n;
+		}
+		hull[n++] = p;
+	}
+	if (n < 2) return;
+	meanTick /= count;
+
+	// 平均 tick を含む凸包の辺が、遅延の総和を最小にする直線
+	size_t k = 0;
+	while (k + 2 < n && hull[k + 1].tick < meanTick) ++k;
+	double b = (hull[k + 1].host - hull[k].host) / (hull[k + 1].tick - hull[k].tick);
+
+	// 溜まっていたデータがまとめて届いた直後などは傾きが崩れるので、窓全体の平均周期と比べて検証する
+	const Point& oldest = window[first];
+	const Point& newest = window[(head + windowSize - 1) % windowSize];
+	double span = newest.host - oldest.host;
+	double chord = span / std::max(newest.tick - oldest.tick, 1.0);
+	valid = span >= minSpan && b > chord * 0.5 && b < chord * 2;
+	if (!valid) return;
+
+	period = b;
+	offset = hull[k].host - b * hull[k].tick;
+}
@@ -0,0 +1,56 @@
+﻿#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+// レポートの8bitタイマーからデバイス側の時間軸を復元し、ホストの steady_clock に対応付ける
+// シリアル変換の遅延は常に正なので、(tick, 受信時刻) の下側凸包に直線を当てはめる
+class DeviceClock
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// タイマー値と受信時刻を渡し、補正した取得時刻を返す (単調非減少)
+	Clock::time_point Update(uint8_t timer, Clock::time_point arrival);
+	void Reset();
+
+	uint64_t Ticks() const { return ticks; }            // 巻き戻りを展開したタイマー値
+	double TickPeriod() const { return period; }        // 1tick あたりの秒数 (推定値)
+	bool Locked() const { return valid; }               // 推定が有効か
+
+private:
+	void Fit();
+	Clock::time_point Output(double target, Clock::time_point arrival);
+
+	static constexpr size_t windowSize = 256;
+	static constexpr size_t minPoints = 16;
+	static constexpr size_t fitInterval = 32;
+	static constexpr double minSpan = 0.02;  // 窓が覆う受信時間の最小値 (秒)
+	static constexpr double slewDecay = 0.9; // 1サンプルごとに残す段差の割合
+
+	struct Point
+	{
+		double tick;
+		double host;
+	};
+
+	std::array<Point, windowSize> window = {};
+	size_t head = 0;
+	size_t count = 0;
+
+	bool started = false;
+	uint8_t lastTimer = 0;
+	uint64_t ticks = 0;
+	Clock::time_point origin;
+	double lastHost = 0;
+
+	// host = offset + period * tick
+	double period = 0;
+	double offset = 0;
+	size_t sinceFit = 0;
+	bool valid = false;
+
+	double lastOut = 0; // 前回返した時刻
+	double slew = 0;    // 推定値に上乗せしている段差 (秒)
+};
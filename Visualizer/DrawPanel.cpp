@@ -1,6 +1,8 @@
 ﻿#include "DrawPanel.h"
 #include <wx/dcbuffer.h>
 #include <wx/dcgraph.h>
+#include <wx/display.h>
+#include <algorithm>
 #include <iostream>
 #include "MainFrame.h"
 
@@ -15,7 +17,19 @@ DrawPanel::DrawPanel(wxWindow* parent) : wxPanel(parent, wxID_ANY), m_timer(this
     SetBackgroundStyle(wxBG_STYLE_PAINT);
     SetBackgroundColour(*wxBLACK);
 
-    m_timer.Start(8); // 8msごとにタイマーイベント
+    UpdateRefreshRate();
+}
+
+void DrawPanel::UpdateRefreshRate() {
+    int index = wxDisplay::GetFromWindow(this);
+    int hz = 0;
+    if (index != wxNOT_FOUND) hz = wxDisplay(index).GetCurrentMode().refresh;
+    if (hz <= 0) hz = 125; // 取得できなければレポート周期 (8ms)
+
+    if (hz == m_refreshHz && m_timer.IsRunning()) return;
+    m_refreshHz = hz;
+    // wxTimer は ms 単位なので、描画位置は OnPaint 時点の時刻から求める (Presenter)
+    m_timer.Start(std::max(1, 1000 / hz));
 }
 
 void DrawPanel::ClearBackground(wxGCDC& gdc) {
@@ -82,24 +96,20 @@ void DrawPanel::OnPaint(wxPaintEvent& event) {
 
 	//wxPen anyColorPen(wxColour(R, G, B), width);
 
+	// GamePad情報取得
 	MainFrame* frame = dynamic_cast<MainFrame*>(GetParent());
-	if (!frame || !frame->m_serial || !frame->m_serial->IsOpen()) {
-		// シリアルポートが開かれていない場合は描画しない
+    SwitchPro::GamePad gamepad;
+	if (!frame || !frame->GetDisplayPad(gamepad)) {
+		// シリアルポートが開かれておらず、セッションも再生していない場合は描画しない
 		return;
 	}
 
-	// GamePad情報取得
-    SwitchPro::GamePad gamepad = dynamic_cast<MainFrame*>(GetParent())->m_serial->GetGamePad();
-
     short radius;
     short center_x;
     short center_y;
     short offset;
     double stick_x, stick_y;
 
-	// LRスティック
-	double deadzone = 0.05;
-
 	// Lスティック
     gdc.SetPen(whitePen);
 	gdc.SetBrush(*wxTRANSPARENT_BRUSH);
@@ -121,15 +131,10 @@ void DrawPanel::OnPaint(wxPaintEvent& event) {
 	gdc.SetBrush(*wxBLACK);
 	gdc.SetPen(gamepad.L3 ? redPen : whitePen);
   
+    // デッドゾーン等は SerialAnalizer 側で処理済み
     stick_x = (double)gamepad.LX / 2048;
     stick_y = (double)gamepad.LY / 2048;
 
-	// デッドゾーン
-	if (hypot(stick_x, stick_y) < deadzone) {
-		stick_x = 0;
-		stick_y = 0;
-	}
-
 	stick_x = center_x + stick_x * radius;
 	stick_y = center_y - stick_y * radius;
 
@@ -159,12 +164,6 @@ void DrawPanel::OnPaint(wxPaintEvent& event) {
 	stick_x = (double)gamepad.RX / 2048;
 	stick_y = (double)gamepad.RY / 2048;
 
-	// デッドゾーン
-	if (hypot(stick_x, stick_y) < deadzone) {
-		stick_x = 0;
-		stick_y = 0;
-	}
-
 	stick_x = center_x + stick_x * radius;
 	stick_y = center_y - stick_y * radius;
 
@@ -315,5 +314,10 @@ void DrawPanel::OnPaint(wxPaintEvent& event) {
 }
 
 void DrawPanel::OnTimer(wxTimerEvent& event) {
+    // ウィンドウが別のディスプレイに移ったときのため、1秒ごとに確認する
+    if (++m_ticks >= m_refreshHz) {
+        m_ticks = 0;
+        UpdateRefreshRate();
+    }
     Refresh(); // 再描画要求
 }
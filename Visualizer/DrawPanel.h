@@ -12,8 +12,12 @@ private:
 	void ClearBackground(wxGCDC& gdc);
 	void OnPaint(wxPaintEvent& event);
 	void OnTimer(wxTimerEvent& event);
+	// 表示しているディスプレイのリフレッシュレートに合わせてタイマーを設定する
+	void UpdateRefreshRate();
 
 	wxTimer m_timer;
+	int m_refreshHz = 0;
+	int m_ticks = 0;
 
 	wxDECLARE_EVENT_TABLE();
 };
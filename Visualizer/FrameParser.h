@@ -0,0 +1,76 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+
+namespace SwitchPro
+{
+    // usb.ino のフレーム (0xAA, 長さ, レポート, 0xBB) を受信バイト列から切り出す
+    // 読み込みの区切りとフレームの区切りが一致している必要はない
+    class FrameParser
+    {
+    public:
+        static constexpr uint8_t START_BYTE = 0xAA;
+        static constexpr uint8_t END_BYTE = 0xBB;
+
+        // 完成したフレームごとに onFrame(const uint8_t* report, uint8_t length) を呼ぶ
+        template <typename OnFrame>
+        void Feed(const uint8_t* data, size_t size, OnFrame&& onFrame) {
+            const uint8_t* end = data + size;
+            while (data < end) {
+                switch (state) {
+                case State::Start: {
+                    // 開始バイトまで読み飛ばす
+                    auto p = (const uint8_t*)memchr(data, START_BYTE, end - data);
+                    if (!p) return;
+                    data = p + 1;
+                    state = State::Length;
+                    break;
+                }
+                case State::Length:
+                    length = *data++;
+                    pos = 0;
+                    state = length ? State::Payload : State::End;
+                    break;
+
+                case State::Payload: {
+                    size_t n = length - pos;
+                    if (n > (size_t)(end - data)) n = end - data;
+                    memcpy(report + pos, data, n);
+                    pos += (uint8_t)n;
+                    data += n;
+                    if (pos == length) state = State::End;
+                    break;
+                }
+                case State::End:
+                    if (*data++ == END_BYTE) {
+                        ++frames;
+                        onFrame((const uint8_t*)report, length);
+                    }
+                    else {
+                        ++dropped;
+                    }
+                    state = State::Start;
+                    break;
+                }
+            }
+        }
+
+        void Reset() { state = State::Start; }
+
+        uint64_t Frames() const { return frames; }
+        uint64_t Dropped() const { return dropped; }
+
+    private:
+        enum class State { Start, Length, Payload, End };
+
+        State state = State::Start;
+        uint8_t length = 0;
+        uint8_t pos = 0;
+        uint8_t report[255] = {};
+
+        uint64_t frames = 0;
+        uint64_t dropped = 0;
+    };
+};
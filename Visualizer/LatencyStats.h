@@ -0,0 +1,60 @@
+﻿#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// µs 単位の遅延ヒストグラム
+// 16µs までは 1µs 刻み、それ以降は2の冪ごとに16分割 (相対誤差 6% 以下)
+// 書き込みは1スレッドのみ。読み出しはどのスレッドからでもよい (多少古い値になるだけ)
+class LatencyStats
+{
+public:
+	void Add(int64_t us) {
+		uint64_t v = us < 0 ? 0 : (uint64_t)us;
+		auto& b = buckets[Index(v)];
+		b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		if (v > max.load(std::memory_order_relaxed)) max.store(v, std::memory_order_relaxed);
+		count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+	uint64_t Max() const { return max.load(std::memory_order_relaxed); }
+
+	// p: 0-1。該当バケットの下限を返す
+	uint64_t Percentile(double p) const {
+		uint64_t total = 0;
+		for (const auto& b : buckets) total += b.load(std::memory_order_relaxed);
+		if (total == 0) return 0;
+
+		uint64_t target = (uint64_t)(p * (total - 1)) + 1;
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BUCKETS; ++i) {
+			seen += buckets[i].load(std::memory_order_relaxed);
+			if (seen >= target) return LowerBound(i);
+		}
+		return LowerBound(BUCKETS - 1);
+	}
+
+private:
+	static constexpr int MAX_BIT = 30; // ~1000 秒
+	static constexpr size_t BUCKETS = (MAX_BIT - 3) * 16 + 16;
+
+	static size_t Index(uint64_t v) {
+		if (v < 16) return (size_t)v;
+		int msb = 63;
+		while (!(v >> msb)) --msb;
+		if (msb > MAX_BIT) return BUCKETS - 1;
+		return (size_t)(msb - 3) * 16 + ((v >> (msb - 4)) & 15);
+	}
+
+	static uint64_t LowerBound(size_t i) {
+		if (i < 16) return i;
+		int msb = (int)(i / 16) + 3;
+		return (uint64_t)(16 + i % 16) << (msb - 4);
+	}
+
+	std::array<std::atomic<uint32_t>, BUCKETS> buckets{};
+	std::atomic<uint64_t> max{ 0 };
+	std::atomic<uint64_t> count{ 0 };
+};
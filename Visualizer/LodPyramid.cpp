@@ -0,0 +1,97 @@
+﻿#include "LodPyramid.h"
+#include <algorithm>
+
+
+void LodPyramid::Clear() {
+	time.clear();
+	base.clear();
+	levels.clear();
+}
+
+void LodPyramid::Merge(Bucket& into, const Bucket& b) {
+	for (int a = 0; a < 4; ++a) {
+		into.min[a] = std::min(into.min[a], b.min[a]);
+		into.max[a] = std::max(into.max[a], b.max[a]);
+	}
+	into.buttons |= b.buttons;
+}
+
+void LodPyramid::Append(const SessionArchive::Sample& s) {
+	Bucket b;
+	for (int a = 0; a < 4; ++a) b.min[a] = b.max[a] = s.axis[a];
+	b.buttons = s.buttons;
+	Push(s.timeUs, b);
+}
+
+void LodPyramid::DropFront(size_t n) {
+	n = std::min(n, time.size());
+	std::vector<int64_t> keepTime(time.begin() + n, time.end());
+	std::vector<Bucket> keepBase(base.begin() + n, base.end());
+	Clear();
+	time.reserve(keepTime.size());
+	base.reserve(keepBase.size());
+	for (size_t i = 0; i < keepTime.size(); ++i) Push(keepTime[i], keepBase[i]);
+}
+
+void LodPyramid::Push(int64_t timeUs, const Bucket& b) {
+	time.push_back(timeUs);
+	base.push_back(b);
+
+	// 2つ揃ったバケットを上のレベルへ繰り上げる
+	for (size_t k = 0;; ++k) {
+		const std::vector<Bucket>& below = k == 0 ? base : levels[k - 1];
+		if (below.size() % 2 != 0) break;
+
+		Bucket merged = below[below.size() - 2];
+		Merge(merged, below.back());
+		if (levels.size() <= k) levels.emplace_back();
+		levels[k].push_back(merged);
+	}
+}
+
+size_t LodPyramid::LowerBound(int64_t timeUs) const {
+	return std::lower_bound(time.begin(), time.end(), timeUs) - time.begin();
+}
+
+LodPyramid::Summary LodPyramid::Query(size_t i0, size_t i1) const {
+	Summary s = {};
+	s.empty = true;
+	i1 = std::min(i1, time.size());
+
+	Bucket acc = {};
+	while (i0 < i1) {
+		// i0 から始まり [i0, i1) に収まる最大のバケットを使う
+		size_t level = 0;
+		while (level < levels.size()) {
+			size_t size = (size_t)2 << level;
+			if (i0 % size != 0 || i0 + size > i1 || (i0 / size) >= levels[level].size()) break;
+			++level;
+		}
+		const Bucket& b = level == 0 ? base[i0] : levels[level - 1][i0 >> level];
+		if (s.empty) {
+			acc = b;
+			s.empty = false;
+		}
+		else {
+			Merge(acc, b);
+		}
+		i0 += (size_t)1 << level;
+	}
+
+	if (!s.empty) {
+		std::copy(acc.min, acc.min + 4, s.min);
+		std::copy(acc.max, acc.max + 4, s.max);
+		s.buttons = acc.buttons;
+	}
+	return s;
+}
+
+SwitchPro::GamePad LodPyramid::PadAt(size_t i) const {
+	SwitchPro::GamePad gp = {};
+	SwitchPro::ApplyButtonMask(base[i].buttons, gp);
+	gp.LX = base[i].min[0];
+	gp.LY = base[i].min[1];
+	gp.RX = base[i].min[2];
+	gp.RY = base[i].min[3];
+	return gp;
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "SessionArchive.h"
+
+// 長いセッションを描画するための多重解像度の要約 (ミップマップ)
+// レベル L のバケットは 2^L サンプル分の各軸の最小・最大とボタンの論理和を持つ
+// 追加は償却 O(1)、任意の範囲の要約は O(log n)
+class LodPyramid
+{
+public:
+	struct Summary
+	{
+		int16_t min[4];
+		int16_t max[4];
+		uint32_t buttons;  // 範囲内で一度でも押されたボタン
+		bool empty;
+	};
+
+	void Clear();
+	void Append(const SessionArchive::Sample& s);
+	// 先頭の n サンプルを捨てる (残りから要約を作り直すので O(n))
+	void DropFront(size_t n);
+
+	size_t Size() const { return time.size(); }
+	int64_t StartUs() const { return time.empty() ? 0 : time.front(); }
+	int64_t EndUs() const { return time.empty() ? 0 : time.back(); }
+
+	// timeUs 以上となる最初のサンプル番号
+	size_t LowerBound(int64_t timeUs) const;
+	// サンプル [i0, i1) の要約
+	Summary Query(size_t i0, size_t i1) const;
+
+	int64_t TimeAt(size_t i) const { return time[i]; }
+	SwitchPro::GamePad PadAt(size_t i) const;
+
+private:
+	struct Bucket
+	{
+		int16_t min[4];
+		int16_t max[4];
+		uint32_t buttons;
+	};
+
+	static void Merge(Bucket& into, const Bucket& b);
+	void Push(int64_t timeUs, const Bucket& b);
+
+	// レベル0 (サンプルそのもの)
+	std::vector<int64_t> time;
+	std::vector<Bucket> base;
+	// levels[k] はレベル k+1
+	std::vector<std::vector<Bucket>> levels;
+};
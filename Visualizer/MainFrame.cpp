@@ -1,39 +1,116 @@
 ﻿#include "MainFrame.h"
-#include "SerialUtils.h"
+#include <wx/filedlg.h>
 
 
-MainFrame::MainFrame(const wxString& title) : wxFrame(NULL, wxID_ANY, title) {
+MainFrame::MainFrame(const wxString& title) : wxFrame(NULL, wxID_ANY, title), m_watchTimer(this) {
 	m_drawPanel = new DrawPanel(this);
+	m_timeline = new TimelinePanel(this);
+
+	wxMenu* fileMenu = new wxMenu;
+	fileMenu->Append(ID_OPEN_SESSION, "&Open session...\tCtrl+O");
+	fileMenu->Append(ID_CLOSE_SESSION, "&Close session");
+	fileMenu->AppendSeparator();
+	fileMenu->AppendCheckItem(ID_RECORD, "&Record...\tCtrl+R");
+	wxMenuBar* menuBar = new wxMenuBar;
+	menuBar->Append(fileMenu, "&File");
+	wxMenu* viewMenu = new wxMenu;
+	viewMenu->Append(ID_SCOPE, "&Scope");
+	viewMenu->AppendSeparator();
+	viewMenu->AppendRadioItem(ID_PRESENT_LATEST, "&Latest input");
+	viewMenu->AppendRadioItem(ID_PRESENT_INTERPOLATE, "&Interpolate");
+	viewMenu->AppendRadioItem(ID_PRESENT_EXTRAPOLATE, "&Extrapolate");
+	viewMenu->Append(ID_PREDICTION_LEAD, "Prediction &lead...");
+	menuBar->Append(viewMenu, "&View");
+	// 次の接続から有効
+	wxMenu* optionsMenu = new wxMenu;
+	optionsMenu->AppendCheckItem(ID_LOW_LATENCY, "&Low latency port");
+	optionsMenu->AppendCheckItem(ID_REALTIME, "&Realtime reader thread");
+	optionsMenu->Append(ID_PIN_CPU, "&Pin reader to CPU...");
+	optionsMenu->AppendSeparator();
+	optionsMenu->AppendCheckItem(ID_VIRTUAL_PAD, "&Virtual gamepad (uinput)");
+	wxMenu* filterMenu = new wxMenu;
+	const auto& presets = StickFilter::Presets();
+	for (size_t i = 0; i < presets.size(); ++i) {
+		filterMenu->AppendRadioItem(ID_FILTER + (int)i, presets[i].label);
+	}
+	optionsMenu->AppendSubMenu(filterMenu, "Stick &filter");
+	menuBar->Append(optionsMenu, "&Options");
+	SetMenuBar(menuBar);
+	CreateStatusBar(2);
 	
 	wxPanel* topPanel = new wxPanel(this);
 	wxBoxSizer* topSizer = new wxBoxSizer(wxHORIZONTAL);
 
 	m_comChoice = new wxChoice(topPanel, wxID_ANY);
 	m_connectButton = new wxButton(topPanel, wxID_ANY, "Connect");
+	m_autoCheck = new wxCheckBox(topPanel, wxID_ANY, "Auto");
 
-	auto ports = SerialUtils::AvailablePorts();
-	for (const auto & p : ports) {
-		m_comChoice->Append(wxString::Format("%s (%s)", p.port, p.description));
-	}
+	RefreshPorts();
 
 	topSizer->Add(m_comChoice, 1, wxEXPAND | wxRIGHT);
 	topSizer->Add(m_connectButton, 0, wxEXPAND);
+	topSizer->Add(m_autoCheck, 0, wxALIGN_CENTER_VERTICAL | wxLEFT, 4);
 
 	topPanel->SetSizer(topSizer);
 
 	wxBoxSizer* mainSizer = new wxBoxSizer(wxVERTICAL);
 	mainSizer->Add(topPanel, 0, wxEXPAND | wxALL);
 	mainSizer->Add(m_drawPanel, 1, wxEXPAND);
+	mainSizer->Add(m_timeline, 0, wxEXPAND);
 	this->SetSizer(mainSizer);
 
 	m_connectButton->Bind(wxEVT_BUTTON, &MainFrame::OnConnect, this);
+	m_autoCheck->Bind(wxEVT_CHECKBOX, &MainFrame::OnAuto, this);
+	Bind(wxEVT_MENU, &MainFrame::OnRecord, this, ID_RECORD);
+	Bind(wxEVT_MENU, &MainFrame::OnOpenSession, this, ID_OPEN_SESSION);
+	Bind(wxEVT_MENU, &MainFrame::OnCloseSession, this, ID_CLOSE_SESSION);
+	Bind(wxEVT_MENU, &MainFrame::OnScope, this, ID_SCOPE);
+	Bind(wxEVT_MENU, &MainFrame::OnTuning, this, ID_LOW_LATENCY, ID_PIN_CPU);
+	Bind(wxEVT_MENU, &MainFrame::OnPresentation, this, ID_PRESENT_LATEST, ID_PREDICTION_LEAD);
+	Bind(wxEVT_MENU, &MainFrame::OnVirtualPad, this, ID_VIRTUAL_PAD);
+	Bind(wxEVT_MENU, &MainFrame::OnFilter, this, ID_FILTER, ID_FILTER + (int)presets.size() - 1);
+	Bind(wxEVT_TIMER, &MainFrame::OnWatchTimer, this, m_watchTimer.GetId());
+	m_watchTimer.Start(100); // 切断検出用
+
+	// ポートの抜き差しを監視して一覧を更新する
+	m_portMonitor = new SerialUtils::PortMonitor([this] {
+		CallAfter(&MainFrame::RefreshPorts);
+	});
+}
+
+MainFrame::~MainFrame() {
+	m_watchTimer.Stop();
+	delete m_autoConnector;
+	delete m_portMonitor;
+	delete m_serial;
+	m_serial = nullptr;
+	delete m_recorder;
+}
+
+void MainFrame::RefreshPorts() {
+	// 選択中のポートは一覧更新後も選択したままにする
+	std::string selected;
+	int sel = m_comChoice->GetSelection();
+	if (sel != wxNOT_FOUND && sel < (int)m_ports.size()) {
+		selected = m_ports[sel].port;
+	}
+
+	m_ports = SerialUtils::AvailablePorts();
+
+	m_comChoice->Clear();
+	for (size_t i = 0; i < m_ports.size(); ++i) {
+		const auto& p = m_ports[i];
+		m_comChoice->Append(wxString::Format("%s (%s)", p.port, p.description));
+		if (p.port == selected) m_comChoice->SetSelection(i);
+	}
+
+	// 自動接続中なら新しいポートをすぐに探す
+	if (m_autoConnector) m_autoConnector->Rescan();
 }
 
 void MainFrame::OnConnect(wxCommandEvent& event) {
 	if (m_serial && m_serial->IsOpen()) {
-		delete m_serial;
-		m_serial = nullptr;
-		m_connectButton->SetLabel("Connect");
+		Disconnect();
 	}
 	else {
 		int sel = m_comChoice->GetSelection();
@@ -42,10 +119,8 @@ void MainFrame::OnConnect(wxCommandEvent& event) {
 			return;
 		}
 
-		wxString portStr = m_comChoice->GetString(sel);
-		portStr = portStr.BeforeFirst('('); // Extract port name before '('
-
-		if (TryOpenPort(std::string(portStr.mb_str()))) {
+		if (TryOpenPort(m_ports[sel].port)) {
+			AttachSinks();
 			m_connectButton->SetLabel("Disconnect");
 		}
 		else {
@@ -54,19 +129,229 @@ void MainFrame::OnConnect(wxCommandEvent& event) {
 	}
 }
 
-bool MainFrame::TryOpenPort(const std::string& portName) {
-	try {
-		m_serial = new SerialAnalizer(portName);
-		
-		if (!m_serial->ReadOnce(200)) {
-			delete m_serial;
-			m_serial = nullptr;
-			return false;
+void MainFrame::Disconnect() {
+	delete m_serial;
+	m_serial = nullptr;
+	m_connectButton->SetLabel("Connect");
+	// 自動接続中なら探索を再開する
+	if (m_autoConnector) m_autoConnector->Disconnected();
+}
+
+void MainFrame::OnAuto(wxCommandEvent& event) {
+	if (m_autoCheck->IsChecked()) {
+		if (m_serial) Disconnect();
+		m_comChoice->Disable();
+		m_connectButton->Disable();
+		int generation = ++m_autoGeneration;
+		m_autoConnector = new AutoConnector([this, generation](SerialAnalizer* serial) {
+			CallAfter([this, serial, generation] { OnAutoConnected(serial, generation); });
+		}, m_tuning);
+	}
+	else {
+		delete m_autoConnector;
+		m_autoConnector = nullptr;
+		if (m_serial) Disconnect();
+		m_comChoice->Enable();
+		m_connectButton->Enable();
+	}
+}
+
+void MainFrame::OnAutoConnected(SerialAnalizer* serial, int generation) {
+	// 自動接続を止めた後 (または作り直す前) の AutoConnector から届いた接続は破棄する
+	if (!m_autoConnector || generation != m_autoGeneration) {
+		delete serial;
+		return;
+	}
+	// 既に接続中なら破棄し、報告した AutoConnector の探索を再開させる (止まったままにしない)
+	if (m_serial) {
+		delete serial;
+		m_autoConnector->Disconnected();
+		return;
+	}
+	m_serial = serial;
+	AttachSinks();
+	m_connectButton->SetLabel("Disconnect");
+}
+
+void MainFrame::AttachSinks() {
+	// 前の接続のライブ表示は時間軸が違うので捨てる
+	m_timeline->ResetLive();
+	m_serial->SetStickFilter(*StickFilter::Presets()[m_filterPreset].create());
+	m_serial->AddSink(m_timeline);
+	m_serial->AddSink(&m_presenter);
+	// 記録中なら再接続後も同じファイルに続けて書く
+	if (m_recorder) m_serial->AddSink(m_recorder);
+	if (m_scopeFrame && m_scopeFrame->IsShown()) m_serial->AddSink(m_scopeFrame->GetScope());
+	if (m_virtualPad.IsOpen()) m_serial->AddSink(&m_virtualPad);
+}
+
+bool MainFrame::GetDisplayPad(SwitchPro::GamePad& gp) {
+	if (m_timeline->GetCursorPad(gp)) return true;
+	if (!m_serial || !m_serial->IsOpen()) return false;
+	// 描画時刻に合わせて補間・予測した値 (Latest なら最新のサンプル)
+	if (m_presenter.Evaluate(std::chrono::steady_clock::now(), gp)) return true;
+	gp = m_serial->GetGamePad();
+	return true;
+}
+
+void MainFrame::OnOpenSession(wxCommandEvent& event) {
+	wxFileDialog dialog(this, "Open session", "", "", "Session files (*.ivs)|*.ivs", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+	if (dialog.ShowModal() != wxID_OK) return;
+
+	if (!m_timeline->LoadSession(std::string(dialog.GetPath().mb_str()))) {
+		wxMessageBox("Failed to open the session file", "Error", wxOK | wxICON_ERROR);
+	}
+}
+
+void MainFrame::OnCloseSession(wxCommandEvent& event) {
+	m_timeline->CloseSession();
+}
+
+void MainFrame::OnScope(wxCommandEvent& event) {
+	// 初めて開いたときに作り、以降は表示を切り替えるだけ
+	if (!m_scopeFrame) {
+		m_scopeFrame = new ScopeFrame(this);
+		m_scopeFrame->Bind(wxEVT_SHOW, &MainFrame::OnScopeShow, this);
+	}
+	m_scopeFrame->Show();
+	m_scopeFrame->Raise();
+}
+
+void MainFrame::OnScopeShow(wxShowEvent& event) {
+	// 表示している間だけ sink にする (二重に登録しないよう先に外す)
+	if (m_serial) {
+		m_serial->RemoveSink(m_scopeFrame->GetScope());
+		if (event.IsShown()) m_serial->AddSink(m_scopeFrame->GetScope());
+	}
+	event.Skip();
+}
+
+void MainFrame::OnTuning(wxCommandEvent& event) {
+	switch (event.GetId()) {
+	case ID_LOW_LATENCY:
+		m_tuning.lowLatency = event.IsChecked();
+		break;
+	case ID_REALTIME:
+		m_tuning.priority = event.IsChecked() ? 50 : 0;
+		break;
+	case ID_PIN_CPU: {
+		// キャンセル時は空文字列が返るので変更しない
+		wxString text = wxGetTextFromUser("CPU index for the reader thread (-1: no pinning)", "Pin reader to CPU",
+			wxString::Format("%d", m_tuning.cpu), this);
+		long cpu;
+		if (text.ToLong(&cpu) && cpu >= -1) m_tuning.cpu = (int)cpu;
+		break;
+	}
+	}
+}
+
+void MainFrame::OnPresentation(wxCommandEvent& event) {
+	switch (event.GetId()) {
+	case ID_PRESENT_LATEST:
+		m_presenter.SetMode(Presenter::Mode::Latest);
+		break;
+	case ID_PRESENT_INTERPOLATE:
+		m_presenter.SetMode(Presenter::Mode::Interpolate);
+		break;
+	case ID_PRESENT_EXTRAPOLATE:
+		m_presenter.SetMode(Presenter::Mode::Extrapolate);
+		break;
+	case ID_PREDICTION_LEAD: {
+		wxString text = wxGetTextFromUser("Extrapolation lead in milliseconds", "Prediction lead",
+			wxString::Format("%g", m_presenter.GetLead().count() / 1000.0), this);
+		double ms;
+		if (text.ToDouble(&ms) && ms >= 0 && ms <= 50) {
+			m_presenter.SetLead(std::chrono::microseconds((int64_t)(ms * 1000)));
 		}
-		return true;
+		break;
+	}
+	}
+}
+
+void MainFrame::OnVirtualPad(wxCommandEvent& event) {
+	if (!event.IsChecked()) {
+		if (m_serial) m_serial->RemoveSink(&m_virtualPad);
+		m_virtualPad.Close();
+		return;
 	}
-	catch (const std::exception& e) {
-		m_serial = nullptr;
-		return false;
-	}	
+	if (!m_virtualPad.Open()) {
+		GetMenuBar()->Check(ID_VIRTUAL_PAD, false);
+		wxMessageBox("Failed to create the virtual gamepad (is /dev/uinput writable?)", "Error", wxOK | wxICON_ERROR);
+		return;
+	}
+	if (m_serial) m_serial->AddSink(&m_virtualPad);
+}
+
+void MainFrame::OnFilter(wxCommandEvent& event) {
+	m_filterPreset = event.GetId() - ID_FILTER;
+	if (m_serial) m_serial->SetStickFilter(*StickFilter::Presets()[m_filterPreset].create());
+}
+
+void MainFrame::OnRecord(wxCommandEvent& event) {
+	if (m_recorder) {
+		StopRecording();
+		return;
+	}
+
+	wxString name = wxDateTime::Now().Format("session_%Y%m%d_%H%M%S.ivs");
+	wxFileDialog dialog(this, "Save session", "", name, "Session files (*.ivs)|*.ivs", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+	if (dialog.ShowModal() != wxID_OK) {
+		GetMenuBar()->Check(ID_RECORD, false);
+		return;
+	}
+
+	m_recorder = new SessionArchive::Writer;
+	if (!m_recorder->Open(std::string(dialog.GetPath().mb_str()))) {
+		delete m_recorder;
+		m_recorder = nullptr;
+		GetMenuBar()->Check(ID_RECORD, false);
+		wxMessageBox("Failed to create the session file", "Error", wxOK | wxICON_ERROR);
+		return;
+	}
+	if (m_serial) m_serial->AddSink(m_recorder);
+}
+
+void MainFrame::StopRecording() {
+	if (m_serial) m_serial->RemoveSink(m_recorder);
+	m_recorder->Close();
+	bool failed = m_recorder->Failed();
+	delete m_recorder;
+	m_recorder = nullptr;
+	GetMenuBar()->Check(ID_RECORD, false);
+	if (failed) {
+		wxMessageBox("Failed to write the session file. The recording is incomplete.", "Error", wxOK | wxICON_ERROR);
+	}
+}
+
+void MainFrame::OnWatchTimer(wxTimerEvent& event) {
+	// 読み込みスレッドが止まっていたら切断扱いにする
+	if (m_serial && !m_serial->IsRunning()) {
+		Disconnect();
+	}
+	// 書き込みに失敗したら記録を止めて知らせる
+	if (m_recorder && m_recorder->Failed()) StopRecording();
+	if (++m_statusTicks % 10 == 0) UpdateStatus();
+}
+
+void MainFrame::UpdateStatus() {
+	if (!m_serial) {
+		SetStatusText("", 0);
+		SetStatusText("", 1);
+		return;
+	}
+	const LatencyStats& read = m_serial->ReadLatency();
+	const LatencyStats& device = m_serial->DeviceLatency();
+	SetStatusText(wxString::Format("read p50 %llu / p99 %llu us, device p50 %llu / p99 %llu us",
+		(unsigned long long)read.Percentile(0.5), (unsigned long long)read.Percentile(0.99),
+		(unsigned long long)device.Percentile(0.5), (unsigned long long)device.Percentile(0.99)), 0);
+	SetStatusText(m_serial->GetTuning().ToString(), 1);
+}
+
+bool MainFrame::TryOpenPort(const std::string& portName) {
+	// 自動接続と同じ手順で開く。レポートが届かなければ失敗
+	// (読み込みスレッドを始める前に確認するので、同じポートを2つのスレッドで読まない)
+	m_serial = SerialAnalizer::Probe(portName, SerialAnalizer::NEUTRAL_TIMEOUT_MS, m_tuning);
+	if (!m_serial) return false;
+	m_serial->Start();
+	return true;
 }
@@ -3,19 +3,79 @@
 #include <wx/wx.h>
 #include "DrawPanel.h"
 #include "SerialAnalizer.h"
+#include "SerialUtils.h"
+#include "AutoConnector.h"
+#include "SessionArchive.h"
+#include "TimelinePanel.h"
+#include "ScopeFrame.h"
+#include "Presenter.h"
+#include "VirtualGamepad.h"
 
 class MainFrame : public wxFrame
 {
 public:
 	MainFrame(const wxString& title);
+	~MainFrame();
 	SerialAnalizer* m_serial = nullptr;
 
+	// 表示する入力 (スクラブ中はタイムラインのカーソル位置、それ以外は最新の入力)
+	bool GetDisplayPad(SwitchPro::GamePad& gp);
+
 private:
+	enum
+	{
+		ID_RECORD = wxID_HIGHEST + 1,
+		ID_OPEN_SESSION,
+		ID_CLOSE_SESSION,
+		ID_SCOPE,
+		ID_LOW_LATENCY,
+		ID_REALTIME,
+		ID_PIN_CPU,
+		ID_VIRTUAL_PAD,
+		ID_PRESENT_LATEST,
+		ID_PRESENT_INTERPOLATE,
+		ID_PRESENT_EXTRAPOLATE,
+		ID_PREDICTION_LEAD,
+		ID_FILTER,  // ID_FILTER + i が StickFilter::Presets()[i]。最後に置く
+	};
+
 	void OnConnect(wxCommandEvent& event);
+	void OnRecord(wxCommandEvent& event);
+	void OnOpenSession(wxCommandEvent& event);
+	void OnCloseSession(wxCommandEvent& event);
+	void OnScope(wxCommandEvent& event);
+	void OnScopeShow(wxShowEvent& event);
+	void OnTuning(wxCommandEvent& event);
+	void OnPresentation(wxCommandEvent& event);
+	void OnVirtualPad(wxCommandEvent& event);
+	void OnFilter(wxCommandEvent& event);
+	void OnAuto(wxCommandEvent& event);
+	void OnWatchTimer(wxTimerEvent& event);
+	void OnAutoConnected(SerialAnalizer* serial, int generation);
+	void Disconnect();
+	void StopRecording();
+	void AttachSinks();
 	bool TryOpenPort(const std::string& portName);
+	void RefreshPorts();
+	void UpdateStatus();
 
 	DrawPanel* m_drawPanel;
+	TimelinePanel* m_timeline;
+	ScopeFrame* m_scopeFrame = nullptr;
 	wxChoice* m_comChoice;
 	wxButton* m_connectButton;
+	wxCheckBox* m_autoCheck;
+	wxTimer m_watchTimer;
+
+	std::vector<SerialUtils::SerialPortInfo> m_ports;
+	SerialUtils::PortMonitor* m_portMonitor = nullptr;
+	AutoConnector* m_autoConnector = nullptr;
+	int m_autoGeneration = 0;
+	SessionArchive::Writer* m_recorder = nullptr;
+	SerialTuning::Options m_tuning;
+	size_t m_filterPreset = 0;
+	Presenter m_presenter;
+	VirtualGamepad m_virtualPad;
+	int m_statusTicks = 0;
 };
 
@@ -0,0 +1,130 @@
+﻿#include "Presenter.h"
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+	double Us(Presenter::Clock::duration d) {
+		return std::chrono::duration<double, std::micro>(d).count();
+	}
+
+	int16_t ToAxis(double v) {
+		return (int16_t)std::max(-2048.0, std::min(2047.0, std::round(v)));
+	}
+
+	void Axes(const SwitchPro::GamePad& gp, double v[4]) {
+		v[0] = gp.LX;
+		v[1] = gp.LY;
+		v[2] = gp.RX;
+		v[3] = gp.RY;
+	}
+
+	void SetAxes(SwitchPro::GamePad& gp, const double v[4]) {
+		gp.LX = ToAxis(v[0]);
+		gp.LY = ToAxis(v[1]);
+		gp.RX = ToAxis(v[2]);
+		gp.RY = ToAxis(v[3]);
+	}
+}
+
+void Presenter::OnSample(const GamePadSample& sample) {
+	queue.Push(Point{ sample.captured, sample.arrival, sample.pad });
+}
+
+void Presenter::Drain() {
+	Point p;
+	while (queue.Pop(p)) {
+		if (count > 0) {
+			double dt = Us(p.captured - At(0).captured);
+			// 再接続などで時刻が戻ったら履歴を捨てる
+			if (dt < 0 || dt > 1e6) count = 0;
+			else if (dt > 0) periodUs += (std::min(dt, 4 * periodUs) - periodUs) * 0.05;
+		}
+		latencyUs += (Us(p.arrival - p.captured) - latencyUs) * 0.05;
+
+		history[head] = p;
+		head = (head + 1) % HISTORY;
+		count = std::min(count + 1, HISTORY);
+	}
+}
+
+bool Presenter::Evaluate(Clock::time_point now, SwitchPro::GamePad& gp) {
+	Drain();
+	if (count == 0) return false;
+
+	switch (mode) {
+	case Mode::Latest:
+		gp = At(0).pad;
+		break;
+	case Mode::Interpolate:
+		// 次のサンプルが届く前に追い越さないよう、周期 + 転送遅延だけ遅らせる
+		Interpolate(now - std::chrono::microseconds((int64_t)(periodUs + latencyUs)), gp);
+		break;
+	case Mode::Extrapolate:
+		Extrapolate(now + lead, gp);
+		break;
+	}
+	return true;
+}
+
+void Presenter::Interpolate(Clock::time_point t, SwitchPro::GamePad& gp) const {
+	if (t >= At(0).captured || count == 1) {
+		gp = At(0).pad;
+		return;
+	}
+	for (size_t i = 1; i < count; ++i) {
+		const Point& a = At(i);
+		const Point& b = At(i - 1);
+		if (t < a.captured) continue;
+
+		double span = Us(b.captured - a.captured);
+		double f = span > 0 ? Us(t - a.captured) / span : 1.0;
+		double va[4], vb[4], v[4];
+		Axes(a.pad, va);
+		Axes(b.pad, vb);
+		for (int k = 0; k < 4; ++k) v[k] = va[k] + (vb[k] - va[k]) * f;
+
+		// ボタンは補間できないので、描画時刻の時点のものを使う
+		gp = a.pad;
+		SetAxes(gp, v);
+		return;
+	}
+	gp = At(count - 1).pad;
+}
+
+void Presenter::Extrapolate(Clock::time_point t, SwitchPro::GamePad& gp) const {
+	const Point& last = At(0);
+	gp = last.pad;
+	int n = (int)std::min<size_t>(count, FIT_POINTS);
+	if (n < 2) return;
+
+	// 直近 n 点の最小二乗で速度を求める (2点差分よりノイズに強い)
+	double ts[FIT_POINTS];
+	double tMean = 0;
+	for (int i = 0; i < n; ++i) {
+		ts[i] = Us(At(i).captured - last.captured);
+		tMean += ts[i];
+	}
+	tMean /= n;
+	double tVar = 0;
+	for (int i = 0; i < n; ++i) tVar += (ts[i] - tMean) * (ts[i] - tMean);
+	if (tVar <= 0) return;
+
+	// 古いサンプルからの外挿で大きく行き過ぎないよう、先読み量を制限する
+	double horizon = std::min(Us(t - last.captured), 2 * periodUs + Us(lead));
+	if (horizon <= 0) return;
+
+	double v[4];
+	Axes(last.pad, v);
+	for (int k = 0; k < 4; ++k) {
+		double cov = 0;
+		for (int i = 0; i < n; ++i) {
+			double x[4];
+			Axes(At(i).pad, x);
+			cov += (ts[i] - tMean) * x[k];
+		}
+		v[k] += cov / tVar * horizon;
+	}
+	SetAxes(gp, v);
+}
@@ -0,0 +1,64 @@
+﻿#pragma once
+#include <array>
+#include <chrono>
+#include "RingBuffer.h"
+#include "SwitchPro.h"
+
+// 描画時刻に合わせてスティック位置を補間・予測する
+// 入力は約125Hz、表示は144-240Hz なので、最新値をそのまま描くとカクつく
+//
+// Interpolate: 1周期ぶん遅らせた時刻で前後のサンプルを線形補間する (滑らかだが遅れる)
+// Extrapolate: 直近のサンプルから速度を推定し、現在時刻 + lead まで外挿する (遅れを隠すが行き過ぎることがある)
+//
+// サンプルは読み込みスレッドから SPSC キューに積むだけ。Evaluate は UI スレッドから呼ぶ
+// 固定長の履歴のみを使うので、1フレームあたりの処理量は一定で確保もしない
+class Presenter : public SampleSink
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	enum class Mode
+	{
+		Latest,
+		Interpolate,
+		Extrapolate,
+	};
+
+	void SetMode(Mode mode) { this->mode = mode; }
+	Mode GetMode() const { return mode; }
+	void SetLead(std::chrono::microseconds lead) { this->lead = lead; }
+	std::chrono::microseconds GetLead() const { return lead; }
+
+	void OnSample(const GamePadSample& sample) override;
+
+	// now 時点で表示する入力。まだサンプルがなければ false
+	bool Evaluate(Clock::time_point now, SwitchPro::GamePad& gp);
+
+private:
+	struct Point
+	{
+		Clock::time_point captured;
+		Clock::time_point arrival;
+		SwitchPro::GamePad pad;
+	};
+
+	static constexpr size_t HISTORY = 8;
+	static constexpr int FIT_POINTS = 4;   // 速度推定に使うサンプル数
+
+	void Drain();
+	const Point& At(size_t back) const { return history[(head + HISTORY - 1 - back) % HISTORY]; }
+	void Interpolate(Clock::time_point t, SwitchPro::GamePad& gp) const;
+	void Extrapolate(Clock::time_point t, SwitchPro::GamePad& gp) const;
+
+	Mode mode = Mode::Latest;
+	std::chrono::microseconds lead{ 0 };
+
+	SpscRing<Point, 256> queue;
+
+	// UI スレッドのみ
+	std::array<Point, HISTORY> history;
+	size_t head = 0;
+	size_t count = 0;
+	double periodUs = 8000;   // レポート周期 (EMA)
+	double latencyUs = 0;     // 取得から到着までの遅延 (EMA)
+};
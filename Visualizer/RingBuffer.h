@@ -0,0 +1,40 @@
+﻿#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+
+// 単一生産者・単一消費者のロックフリーなリングバッファ
+// 生産者 (読み込みスレッド) はブロックもシステムコールもしない
+template <typename T, size_t N>
+class SpscRing
+{
+	static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+	// 満杯なら false を返す (呼び出し側で破棄数を数える)
+	bool Push(const T& value) {
+		size_t w = write.load(std::memory_order_relaxed);
+		if (w - read.load(std::memory_order_acquire) == N) return false;
+		items[w & (N - 1)] = value;
+		write.store(w + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(T& value) {
+		size_t r = read.load(std::memory_order_relaxed);
+		if (r == write.load(std::memory_order_acquire)) return false;
+		value = items[r & (N - 1)];
+		read.store(r + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Empty() const {
+		return read.load(std::memory_order_acquire) == write.load(std::memory_order_acquire);
+	}
+
+private:
+	std::array<T, N> items;
+	alignas(64) std::atomic<size_t> write{ 0 };
+	alignas(64) std::atomic<size_t> read{ 0 };
+};
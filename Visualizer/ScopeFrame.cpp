@@ -0,0 +1,63 @@
+﻿#include "ScopeFrame.h"
+
+
+namespace
+{
+	const int WINDOW_MS[] = { 500, 1000, 2000, 5000, 10000, 30000 };
+}
+
+ScopeFrame::ScopeFrame(wxWindow* parent) : wxFrame(parent, wxID_ANY, "Scope") {
+	wxPanel* topPanel = new wxPanel(this);
+	wxBoxSizer* topSizer = new wxBoxSizer(wxHORIZONTAL);
+
+	m_windowChoice = new wxChoice(topPanel, wxID_ANY);
+	for (int ms : WINDOW_MS) {
+		m_windowChoice->Append(ms < 1000 ? wxString::Format("%d ms", ms) : wxString::Format("%d s", ms / 1000));
+	}
+	m_windowChoice->SetSelection(3);
+	m_rawCheck = new wxCheckBox(topPanel, wxID_ANY, "Raw");
+	m_rawCheck->SetValue(true);
+
+	topSizer->Add(m_windowChoice, 0, wxEXPAND);
+	topSizer->Add(m_rawCheck, 0, wxALIGN_CENTER_VERTICAL | wxLEFT, 4);
+	topPanel->SetSizer(topSizer);
+
+	m_scope = new ScopePanel(this);
+	m_scope->SetWindow(std::chrono::milliseconds(WINDOW_MS[3]));
+
+	wxBoxSizer* mainSizer = new wxBoxSizer(wxVERTICAL);
+	mainSizer->Add(topPanel, 0, wxEXPAND);
+	mainSizer->Add(m_scope, 1, wxEXPAND);
+	SetSizer(mainSizer);
+	SetSize(600, 300);
+
+	m_windowChoice->Bind(wxEVT_CHOICE, &ScopeFrame::OnWindow, this);
+	m_rawCheck->Bind(wxEVT_CHECKBOX, &ScopeFrame::OnRaw, this);
+	Bind(wxEVT_CLOSE_WINDOW, &ScopeFrame::OnClose, this);
+	Bind(wxEVT_SHOW, &ScopeFrame::OnShow, this);
+}
+
+void ScopeFrame::OnWindow(wxCommandEvent& event) {
+	int sel = m_windowChoice->GetSelection();
+	if (sel != wxNOT_FOUND) m_scope->SetWindow(std::chrono::milliseconds(WINDOW_MS[sel]));
+}
+
+void ScopeFrame::OnRaw(wxCommandEvent& event) {
+	m_scope->SetRaw(m_rawCheck->IsChecked());
+}
+
+void ScopeFrame::OnClose(wxCloseEvent& event) {
+	// 設定と履歴を残すため、アプリ終了時以外は隠すだけ
+	if (event.CanVeto()) {
+		event.Veto();
+		Hide();
+		return;
+	}
+	event.Skip();
+}
+
+void ScopeFrame::OnShow(wxShowEvent& event) {
+	if (event.IsShown()) m_scope->Resume();
+	else m_scope->Pause();
+	event.Skip();
+}
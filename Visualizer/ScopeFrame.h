@@ -0,0 +1,23 @@
+﻿#pragma once
+#include <wx/wx.h>
+#include "ScopePanel.h"
+
+// ScopePanel と表示設定を持つウィンドウ。閉じても破棄せず隠すだけ
+// 隠している間はタイマーを止める。sink の登録・解除は持ち主が wxEVT_SHOW で行う
+class ScopeFrame : public wxFrame
+{
+public:
+	ScopeFrame(wxWindow* parent);
+
+	ScopePanel* GetScope() const { return m_scope; }
+
+private:
+	void OnWindow(wxCommandEvent& event);
+	void OnRaw(wxCommandEvent& event);
+	void OnClose(wxCloseEvent& event);
+	void OnShow(wxShowEvent& event);
+
+	ScopePanel* m_scope;
+	wxChoice* m_windowChoice;
+	wxCheckBox* m_rawCheck;
+};
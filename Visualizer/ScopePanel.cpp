@@ -0,0 +1,239 @@
+﻿#include "ScopePanel.h"
+#include <wx/dcbuffer.h>
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+	// LX, LY, RX, RY (TimelinePanel と同じ配色)
+	const unsigned char AXIS_COLOR[4][3] = {
+		{ 255, 255, 255 },
+		{ 140, 140, 140 },
+		{ 255, 255, 0 },
+		{ 150, 150, 0 },
+	};
+}
+
+
+ScopePanel::ScopePanel(wxWindow* parent) : wxPanel(parent, wxID_ANY), m_timer(this) {
+	SetBackgroundStyle(wxBG_STYLE_PAINT);
+	SetBackgroundColour(*wxBLACK);
+
+	m_history.resize(HISTORY);
+	m_density[0].assign(GRID * GRID, 0);
+	m_density[1].assign(GRID * GRID, 0);
+
+	Bind(wxEVT_PAINT, &ScopePanel::OnPaint, this);
+	Bind(wxEVT_SIZE, &ScopePanel::OnSize, this);
+	Bind(wxEVT_TIMER, &ScopePanel::OnTimer, this, m_timer.GetId());
+
+	m_timer.Start(16);
+}
+
+void ScopePanel::Pause() {
+	m_timer.Stop();
+}
+
+void ScopePanel::Resume() {
+	m_dirty = true;
+	if (!m_timer.IsRunning()) m_timer.Start(16);
+}
+
+void ScopePanel::SetWindow(std::chrono::milliseconds window) {
+	m_windowUs = std::chrono::duration_cast<std::chrono::microseconds>(window).count();
+	Rebuild();
+}
+
+void ScopePanel::SetRaw(bool raw) {
+	m_raw = raw;
+	Rebuild();
+}
+
+void ScopePanel::OnSample(const GamePadSample& sample) {
+	if (!m_started) {
+		m_origin = sample.captured;
+		m_started = true;
+	}
+	Entry e;
+	e.us = std::chrono::duration_cast<std::chrono::microseconds>(sample.captured - m_origin).count();
+	for (int a = 0; a < 4; ++a) e.raw[a] = (int16_t)(sample.raw[a] - 2048);
+	e.pad[0] = sample.pad.LX;
+	e.pad[1] = sample.pad.LY;
+	e.pad[2] = sample.pad.RX;
+	e.pad[3] = sample.pad.RY;
+	m_queue.Push(e);
+}
+
+void ScopePanel::OnTimer(wxTimerEvent& event) {
+	Entry e;
+	bool added = false;
+	while (m_queue.Pop(e)) {
+		Add(e);
+		added = true;
+	}
+	if (added || m_dirty) Refresh();
+}
+
+void ScopePanel::OnSize(wxSizeEvent& event) {
+	Rebuild();
+	event.Skip();
+}
+
+int ScopePanel::ScopeWidth() const {
+	wxSize size = GetClientSize();
+	return std::max(size.GetWidth() - size.GetHeight() / 2, 1);
+}
+
+void ScopePanel::Add(const Entry& e) {
+	// 履歴が一杯なら最も古いものを捨てる
+	if (m_end - m_begin == HISTORY) {
+		if (m_densityTail == m_begin) {
+			AddDensity(m_history[m_begin % HISTORY], -1);
+			++m_densityTail;
+		}
+		++m_begin;
+	}
+	m_history[m_end % HISTORY] = e;
+	++m_end;
+
+	AddColumn(e);
+	AddDensity(e, +1);
+
+	// 窓から外れたサンプルを散布図から引く
+	while (m_densityTail < m_end && m_history[m_densityTail % HISTORY].us < e.us - m_windowUs) {
+		AddDensity(m_history[m_densityTail % HISTORY], -1);
+		++m_densityTail;
+	}
+}
+
+void ScopePanel::AddColumn(const Entry& e) {
+	const int64_t width = (int64_t)m_columns.size();
+	if (width == 0) return;
+
+	int64_t slice = e.us / m_sliceUs;
+	if (slice < 0) return; // 負の添字で範囲外に書かないように
+	if (slice > m_slice) {
+		// 進んだ分の列を空にする
+		for (int64_t s = std::max(m_slice + 1, slice - width + 1); s <= slice; ++s) {
+			m_columns[s % width].used = false;
+		}
+		m_slice = slice;
+	}
+	if (slice <= m_slice - width) return;
+
+	Column& c = m_columns[slice % width];
+	const int16_t* v = Values(e);
+	for (int a = 0; a < 4; ++a) {
+		if (!c.used) {
+			c.min[a] = c.max[a] = v[a];
+		}
+		else {
+			c.min[a] = std::min(c.min[a], v[a]);
+			c.max[a] = std::max(c.max[a], v[a]);
+		}
+	}
+	c.used = true;
+}
+
+void ScopePanel::AddDensity(const Entry& e, int sign) {
+	const int16_t* v = Values(e);
+	for (int s = 0; s < 2; ++s) {
+		int gx = std::clamp((v[s * 2] + 2048) * GRID / 4096, 0, GRID - 1);
+		int gy = std::clamp((2047 - v[s * 2 + 1]) * GRID / 4096, 0, GRID - 1);
+		m_density[s][gy * GRID + gx] += sign;
+	}
+}
+
+void ScopePanel::Rebuild() {
+	// 窓・大きさ・表示値が変わったときだけ履歴から作り直す
+	int width = ScopeWidth();
+	m_columns.assign(width, Column{});
+	m_sliceUs = std::max<int64_t>(m_windowUs / width, 1);
+	m_slice = -1;
+	std::fill(m_density[0].begin(), m_density[0].end(), 0);
+	std::fill(m_density[1].begin(), m_density[1].end(), 0);
+
+	m_densityTail = m_end;
+	if (m_end > m_begin) {
+		int64_t newest = m_history[(m_end - 1) % HISTORY].us;
+		while (m_densityTail > m_begin && m_history[(m_densityTail - 1) % HISTORY].us >= newest - m_windowUs) {
+			--m_densityTail;
+		}
+		for (uint64_t i = m_densityTail; i < m_end; ++i) {
+			AddColumn(m_history[i % HISTORY]);
+			AddDensity(m_history[i % HISTORY], +1);
+		}
+	}
+	m_dirty = true;
+}
+
+void ScopePanel::OnPaint(wxPaintEvent& event) {
+	wxAutoBufferedPaintDC dc(this);
+	wxSize size = GetClientSize();
+	int w = size.GetWidth();
+	int h = size.GetHeight();
+	if (w <= 0 || h <= 0) return;
+
+	wxImage img(w, h, true);
+	unsigned char* data = img.GetData();
+	auto put = [&](int x, int y, unsigned char r, unsigned char g, unsigned char b) {
+		unsigned char* p = data + (y * w + x) * 3;
+		p[0] = r;
+		p[1] = g;
+		p[2] = b;
+	};
+
+	// 波形
+	const int scopeW = std::min((int)m_columns.size(), w);
+	const int width = (int)m_columns.size();
+	auto axisY = [&](int v) {
+		return std::clamp(h / 2 - v * (h / 2 - 1) / 2048, 0, h - 1);
+	};
+	for (int x = 0; x < scopeW; ++x) {
+		put(x, h / 2, 40, 40, 40);
+
+		int64_t slice = m_slice - (scopeW - 1 - x);
+		if (slice < 0) continue;
+		const Column& c = m_columns[slice % width];
+		if (!c.used) continue;
+		for (int a = 0; a < 4; ++a) {
+			for (int y = axisY(c.max[a]); y <= axisY(c.min[a]); ++y) {
+				put(x, y, AXIS_COLOR[a][0], AXIS_COLOR[a][1], AXIS_COLOR[a][2]);
+			}
+		}
+	}
+
+	// 散布図 (上: L, 下: R)。明るさは対数スケールの密度
+	const int sq = h / 2;
+	for (int s = 0; s < 2; ++s) {
+		const std::vector<uint32_t>& d = m_density[s];
+		uint32_t peak = std::max<uint32_t>(*std::max_element(d.begin(), d.end()), 1);
+		float scale = 255.0f / std::log1p((float)peak);
+
+		int x0 = scopeW;
+		int y0 = s * sq;
+		for (int y = 0; y < sq; ++y) {
+			for (int x = 0; x < sq && x0 + x < w; ++x) {
+				uint32_t n = d[(y * GRID / sq) * GRID + (x * GRID / sq)];
+				if (n == 0) continue;
+				unsigned char v = (unsigned char)std::min(255.0f, 40 + std::log1p((float)n) * scale);
+				if (s == 0) put(x0 + x, y0 + y, v, v, v);
+				else put(x0 + x, y0 + y, v, v, 0);
+			}
+		}
+	}
+
+	dc.DrawBitmap(wxBitmap(img), 0, 0);
+
+	// 散布図の枠と中心線
+	dc.SetBrush(*wxTRANSPARENT_BRUSH);
+	dc.SetPen(wxPen(wxColour(60, 60, 60)));
+	for (int s = 0; s < 2; ++s) {
+		dc.DrawRectangle(scopeW, s * sq, sq, sq);
+		dc.DrawLine(scopeW + sq / 2, s * sq, scopeW + sq / 2, s * sq + sq);
+		dc.DrawLine(scopeW, s * sq + sq / 2, scopeW + sq, s * sq + sq / 2);
+	}
+
+	m_dirty = false;
+}
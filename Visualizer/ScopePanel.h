@@ -0,0 +1,81 @@
+﻿#pragma once
+#include <wx/wx.h>
+#include <chrono>
+#include <vector>
+#include "RingBuffer.h"
+#include "SwitchPro.h"
+
+// スティックのオシロスコープ (LX/LY/RX/RY の時間変化) と位置の散布図 (密度表示)
+// ドリフト・スナップバック・ゲート形状の確認用
+//
+// サンプルは読み込みスレッドから SPSC キューに積むだけで、UI 側で有限の履歴に移す
+// 波形はピクセル列ごとの最小・最大を到着時に更新しておくので、描画コストは窓内のサンプル数によらない
+class ScopePanel : public wxPanel, public SampleSink
+{
+public:
+	ScopePanel(wxWindow* parent);
+
+	void SetWindow(std::chrono::milliseconds window);
+	// true: 生値 (ニュートラル補正・フィルタ前), false: SerialAnalizer の出力
+	void SetRaw(bool raw);
+
+	void OnSample(const GamePadSample& sample) override;
+
+	// 隠している間は描画用のタイマーを止める
+	void Pause();
+	void Resume();
+
+private:
+	struct Entry
+	{
+		int64_t us;
+		int16_t raw[4];   // 生値 - 2048
+		int16_t pad[4];
+	};
+
+	struct Column
+	{
+		int16_t min[4];
+		int16_t max[4];
+		bool used;
+	};
+
+	static constexpr size_t HISTORY = 1 << 16;
+	static constexpr int GRID = 64;
+
+	void OnPaint(wxPaintEvent& event);
+	void OnTimer(wxTimerEvent& event);
+	void OnSize(wxSizeEvent& event);
+
+	void Add(const Entry& e);
+	void AddColumn(const Entry& e);
+	void AddDensity(const Entry& e, int sign);
+	void Rebuild();
+	const int16_t* Values(const Entry& e) const { return m_raw ? e.raw : e.pad; }
+	int ScopeWidth() const;
+
+	// 読み込みスレッド → UI
+	SpscRing<Entry, 8192> m_queue;
+	bool m_started = false;
+	std::chrono::steady_clock::time_point m_origin;
+
+	// 有限の履歴 (絶対番号 [m_begin, m_end))
+	std::vector<Entry> m_history;
+	uint64_t m_begin = 0;
+	uint64_t m_end = 0;
+
+	int64_t m_windowUs = 5000000;
+	bool m_raw = true;
+
+	// 波形: 時間をピクセル列の幅で区切り、列ごとの最小・最大を持つリング
+	std::vector<Column> m_columns;
+	int64_t m_sliceUs = 1;
+	int64_t m_slice = -1;
+
+	// 散布図: 窓内のサンプルの位置のヒストグラム (L, R)
+	std::vector<uint32_t> m_density[2];
+	uint64_t m_densityTail = 0;
+
+	bool m_dirty = true;
+	wxTimer m_timer;
+};
@@ -1,22 +1,46 @@
 ﻿#include "SerialAnalizer.h"
-#include "MainFrame.h"
+#include "FrameParser.h"
 #include <iostream>
 #include <vector>
 #include <iomanip>
+#include <functional>
+#include <algorithm>
+#include <cmath>
 
 
-SerialAnalizer::SerialAnalizer(const std::string portName) : port(io) {
+SerialAnalizer::SerialAnalizer(const std::string portName, const SerialTuning::Options& tuning) : portName(portName), port(io), tuning(tuning) {
 	if (!OpenSerialPort(portName)) {
 		throw std::runtime_error("Failed to open serial port");
 	}
-	CalcNeutral();
+	std::cout << "Calculating neutral position..." << std::endl;
+	if (CalcNeutral(NEUTRAL_TIMEOUT_MS) == 0) {
+		std::cerr << "Timeout waiting for data." << std::endl;
+		running = false;
+	}
+	std::cout << "Neutral LX: " << neutral_lx << std::endl;
+	std::cout << "Neutral LY: " << neutral_ly << std::endl;
+	std::cout << "Neutral RX: " << neutral_rx << std::endl;
+	std::cout << "Neutral RY: " << neutral_ry << std::endl;
 	worker = std::thread(&SerialAnalizer::ReadLoop, this);
 }
 
+SerialAnalizer::SerialAnalizer(const SerialTuning::Options& tuning) : port(io), tuning(tuning) {
+}
+
 SerialAnalizer::~SerialAnalizer() {
 	running = false;
 	if (worker.joinable()) worker.join();
 	if (port.is_open()) port.close();
+	SerialTuning::Release(tuningReport);
+	delete pendingFilter.load();
+}
+
+void SerialAnalizer::ConfigurePort(asio::serial_port& port) {
+	port.set_option(asio::serial_port_base::baud_rate(115200));
+	port.set_option(asio::serial_port_base::character_size(8));
+	port.set_option(asio::serial_port_base::stop_bits(asio::serial_port_base::stop_bits::one));
+	port.set_option(asio::serial_port_base::parity(asio::serial_port_base::parity::none));
+	port.set_option(asio::serial_port_base::flow_control(asio::serial_port_base::flow_control::none));
 }
 
 bool SerialAnalizer::OpenSerialPort(std::string portName) {
@@ -25,11 +49,8 @@ bool SerialAnalizer::OpenSerialPort(std::string portName) {
 		port.open(portName);
 
 		// ポートの設定
-		port.set_option(asio::serial_port_base::baud_rate(115200));
-		port.set_option(asio::serial_port_base::character_size(8));
-		port.set_option(asio::serial_port_base::stop_bits(asio::serial_port_base::stop_bits::one));
-		port.set_option(asio::serial_port_base::parity(asio::serial_port_base::parity::none));
-		port.set_option(asio::serial_port_base::flow_control(asio::serial_port_base::flow_control::none));
+		ConfigurePort(port);
+		SerialTuning::ApplyPort(port, portName, tuning, tuningReport);
 		std::cout << "port opened" << std::endl;
 	}
 	catch (std::exception& e) {
@@ -39,191 +60,221 @@ bool SerialAnalizer::OpenSerialPort(std::string portName) {
 	return true;
 }
 
-bool SerialAnalizer::ReadOnce(int timeout_ms) {
-	char buf;
-	bool timed_out = false;
-	bool read_ok = false;
+SerialAnalizer* SerialAnalizer::Probe(const std::string& portName, int timeout_ms, const SerialTuning::Options& tuning) {
+	SerialAnalizer* serial = new SerialAnalizer(tuning);
+	serial->portName = portName;
+	asio::serial_port& probe_port = serial->port;
+	try {
+		probe_port.open(portName);
+		ConfigurePort(probe_port);
+	}
+	catch (std::exception&) {
+		delete serial;
+		return nullptr;
+	}
+
+	// 手動接続と同じく、届いたレポートからニュートラルを求める
+	if (serial->CalcNeutral(timeout_ms) == 0) {
+		delete serial;
+		return nullptr;
+	}
+	return serial;
+}
+
+SerialAnalizer* SerialAnalizer::CreateDetached(const SerialTuning::Options& tuning) {
+	return new SerialAnalizer(tuning);
+}
+
+void SerialAnalizer::Start() {
+	if (worker.joinable()) return;
+	SerialTuning::ApplyPort(port, portName, tuning, tuningReport);
+	std::cout << "port opened" << std::endl;
+	worker = std::thread(&SerialAnalizer::ReadLoop, this);
+}
+
+int SerialAnalizer::CalcNeutral(int timeout_ms) {
+	uint8_t buf[256];
+	int found = 0;
+	int sum[4] = { 0 };
 
 	// タイマーを設定
 	asio::steady_timer timer(io);
 	timer.expires_after(std::chrono::milliseconds(timeout_ms));
 	timer.async_wait([&](const asio::error_code& ec) {
 		if (!ec) { // タイムアウト
-			timed_out = true;
-			port.cancel();
+			asio::error_code ignored;
+			port.cancel(ignored);
 		}
 	});
 
-	// 非同期読み込み開始
-	asio::async_read(port, asio::buffer(&buf, 1),
-		[&](const asio::error_code& ec, std::size_t /*length*/) {
-			if (!ec) read_ok = true;
-		});
-
-	// io_context を実行
+	// 届いた分ずつ読み、NEUTRAL_REPORTS 件のレポートの平均をニュートラルにする
+	// 途中のフレームは parser に残り、読み込みスレッドがそのまま続きを読む
+	std::function<void()> read = [&] {
+		port.async_read_some(asio::buffer(buf),
+			[&](const asio::error_code& ec, std::size_t length) {
+				if (ec) return;
+				parser.Feed(buf, length, [&](const uint8_t* report, uint8_t report_length) {
+					if (report_length < 12 || found >= NEUTRAL_REPORTS) return;
+					SwitchPro::InReport rep;
+					uint16_t raw[4];
+					SwitchPro::Parse(report, rep);
+					SwitchPro::UnpackSticks(rep, raw);
+					for (int a = 0; a < 4; ++a) sum[a] += raw[a] - 2048;
+					++found;
+				});
+				if (found >= NEUTRAL_REPORTS) timer.cancel();
+				else read();
+			});
+	};
+	read();
 	io.restart();
-	while (io.run_one()) {
-		// 読み込み成功したらタイマーキャンセル
-		if (read_ok) timer.cancel();
+	io.run();
+
+	// タイムアウトまでに揃わなければ、届いた分だけで平均する
+	if (found) {
+		neutral_lx = sum[0] / found;
+		neutral_ly = sum[1] / found;
+		neutral_rx = sum[2] / found;
+		neutral_ry = sum[3] / found;
 	}
-
-	return read_ok && !timed_out;
+	return found;
 }
 
-void SerialAnalizer::CalcNeutral() {
-	std::cout << "Calculating neutral position..." << std::endl;
+void SerialAnalizer::ReadLoop() {
+	uint8_t buf[256];
+	uint64_t dropped = 0;
 
-	if (!SerialAnalizer::ReadOnce(200)) {
-		std::cerr << "Timeout waiting for data." << std::endl;
-		running = false;
-		return;
+	if (tuning.priority > 0 || tuning.cpu >= 0 || tuning.lockMemory) {
+		std::lock_guard<std::mutex> lock(mtx);
+		SerialTuning::ApplyThread(tuning, tuningReport);
+	}
+	if (tuning.lowLatency || tuning.priority > 0 || tuning.cpu >= 0 || tuning.lockMemory) {
+		std::cout << "Low latency: " << GetTuning().ToString() << std::endl;
 	}
 
-	int buf_lx[128] = { 0 };
-	int buf_ly[128] = { 0 };
-	int buf_rx[128] = { 0 };
-	int buf_ry[128] = { 0 };
-
-	// 20回のデータでニュートラルを計算
-	int n;
-	for (n = 0; n < 20; ++n) {
+	while (running) {
 		try {
-			uint8_t current_byte;
-			asio::read(port, asio::buffer(&current_byte, 1));
-			if (current_byte != startByte) continue;
-
-			uint8_t length;
-			asio::read(port, asio::buffer(&length, 1));
+			// 届いた分をまとめて読み、フレームを切り出す
+			size_t length = port.read_some(asio::buffer(buf));
+			Feed(buf, length, std::chrono::steady_clock::now());
 
-			std::vector<uint8_t> in_report(length, 0);
-
-			asio::read(port, asio::buffer(in_report));
-			asio::read(port, asio::buffer(&current_byte, 1));
-
-			if (current_byte != endByte) {
+			if (parser.Dropped() != dropped) {
+				dropped = parser.Dropped();
 				std::cerr << "Invalid end byte" << std::endl;
-				continue;
 			}
-
-			SwitchPro::InReport rep;
-			std::copy(in_report.begin() + 6, in_report.begin() + 12, rep.joysticks);
-
-			uint16_t lx = rep.joysticks[0] | ((rep.joysticks[1] & 0x0F) << 8);
-			uint16_t ly = (rep.joysticks[1] >> 4) | (rep.joysticks[2] << 4);
-			uint16_t rx = rep.joysticks[3] | ((rep.joysticks[4] & 0x0F) << 8);
-			uint16_t ry = (rep.joysticks[4] >> 4) | (rep.joysticks[5] << 4);
-
-			buf_lx[n] = lx - 2048;
-			buf_ly[n] = ly - 2048;
-			buf_rx[n] = rx - 2048;
-			buf_ry[n] = ry - 2048;
 		}
 		catch (std::exception& e) {
 			std::cerr << "Serial port read error: " << e.what() << std::endl;
 			running = false;
 		}
 	}
-	int sum_lx = 0;
-	int sum_ly = 0;
-	int sum_rx = 0;
-	int sum_ry = 0;
-
-	for (int i = 0; i < n; ++i) {
-		sum_lx += buf_lx[i];
-		sum_ly += buf_ly[i];
-		sum_rx += buf_rx[i];
-		sum_ry += buf_ry[i];
-	}
-
-	std::cout << "Neutral LX: " << sum_lx / n << std::endl;
-	std::cout << "Neutral LY: " << sum_ly / n << std::endl;
-	std::cout << "Neutral RX: " << sum_rx / n << std::endl;
-	std::cout << "Neutral RY: " << sum_ry / n << std::endl;
-
-	neutral_lx = sum_lx / n;
-	neutral_ly = sum_ly / n;
-	neutral_rx = sum_rx / n;
-	neutral_ry = sum_ry / n;
 }
 
-void SerialAnalizer::ReadLoop() {
-	while (running) {
-		try {
-			uint8_t current_byte;
-			asio::read(port, asio::buffer(&current_byte, 1));
-			if (current_byte != startByte) continue;
-
-			uint8_t length;
-			asio::read(port, asio::buffer(&length, 1));
-
-			std::vector<uint8_t> in_report(length, 0);
-			asio::read(port, asio::buffer(in_report));
+void SerialAnalizer::Feed(const uint8_t* data, size_t length, std::chrono::steady_clock::time_point arrival) {
+	parser.Feed(data, length, [&](const uint8_t* report, uint8_t report_length) {
+		if (report_length >= 12) HandleReport(report, arrival);
+	});
+}
 
-			asio::read(port, asio::buffer(&current_byte, 1));
+void SerialAnalizer::HandleReport(const uint8_t* report, std::chrono::steady_clock::time_point arrival) {
+	SwitchPro::InReport rep;
+	SwitchPro::GamePad gp;
+	uint16_t raw[4];
+
+	SwitchPro::Parse(report, rep);
+	SwitchPro::DecodeButtons(rep, gp);
+	SwitchPro::UnpackSticks(rep, raw);
+
+	gp.LX = raw[0] - 2048 - neutral_lx;
+	gp.LY = raw[1] - 2048 - neutral_ly;
+	gp.RX = raw[2] - 2048 - neutral_rx;
+	gp.RY = raw[3] - 2048 - neutral_ry;
+
+	// タイマーから取得時刻を復元する
+	GamePadSample smp;
+	smp.seq = seq++;
+	smp.arrival = arrival;
+	smp.captured = clock.Update(rep.timer, arrival);
+	smp.deviceTicks = clock.Ticks();
+	std::copy(raw, raw + 4, smp.raw);
+
+	// フィルタ処理 (描画側では計算しない)
+	double t = std::chrono::duration<double>(smp.captured.time_since_epoch()).count();
+	ApplyFilter(gp, t);
+	smp.pad = gp;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		sample = smp;
+	}
+	{
+		std::lock_guard<std::mutex> lock(sinkMtx);
+		for (auto* sink : sinks) sink->OnSample(smp);
+	}
 
-			if (current_byte != endByte) {
-				std::cerr << "Invalid end byte" << std::endl;
-				continue;
-			}
+	auto published = std::chrono::steady_clock::now();
+	readLatency.Add(std::chrono::duration_cast<std::chrono::microseconds>(published - arrival).count());
+	if (clock.Locked()) {
+		deviceLatency.Add(std::chrono::duration_cast<std::chrono::microseconds>(published - smp.captured).count());
+	}
+}
 
-			SwitchPro::InReport rep;
-			SwitchPro::GamePad gp;
-
-			rep.report_id = in_report[0];
-			rep.timer     = in_report[1];
-			rep.info      = in_report[2];
-			std::copy(in_report.begin() + 3, in_report.begin() + 6, rep.buttons);
-			std::copy(in_report.begin() + 6, in_report.begin() + 12, rep.joysticks);
-
-			rep.buttons[0] & SwitchPro::Buttons0::A ? gp.A = 1 : gp.A = 0;
-			rep.buttons[0] & SwitchPro::Buttons0::B ? gp.B = 1 : gp.B = 0;
-			rep.buttons[0] & SwitchPro::Buttons0::X ? gp.X = 1 : gp.X = 0;
-			rep.buttons[0] & SwitchPro::Buttons0::Y ? gp.Y = 1 : gp.Y = 0;
-			rep.buttons[2] & SwitchPro::Buttons2::L ? gp.L = 1 : gp.L = 0;
-			rep.buttons[0] & SwitchPro::Buttons0::R ? gp.R = 1 : gp.R = 0;
-			rep.buttons[1] & SwitchPro::Buttons1::L3 ? gp.L3 = 1 : gp.L3 = 0;
-			rep.buttons[1] & SwitchPro::Buttons1::R3 ? gp.R3 = 1 : gp.R3 = 0;
-			rep.buttons[1] & SwitchPro::Buttons1::MINUS ? gp.MINUS = 1 : gp.MINUS = 0;
-			rep.buttons[1] & SwitchPro::Buttons1::PLUS ? gp.PLUS = 1 : gp.PLUS = 0;
-			rep.buttons[1] & SwitchPro::Buttons1::HOME ? gp.HOME = 1 : gp.HOME = 0;
-			rep.buttons[1] & SwitchPro::Buttons1::CAPTURE ? gp.CAPTURE = 1 : gp.CAPTURE = 0;
-
-			rep.buttons[2] & SwitchPro::Buttons2::DPAD_UP ? gp.DPAD_UP = 1 : gp.DPAD_UP = 0;
-			rep.buttons[2] & SwitchPro::Buttons2::DPAD_DOWN ? gp.DPAD_DOWN = 1 : gp.DPAD_DOWN = 0;
-			rep.buttons[2] & SwitchPro::Buttons2::DPAD_LEFT ? gp.DPAD_LEFT = 1 : gp.DPAD_LEFT = 0;
-			rep.buttons[2] & SwitchPro::Buttons2::DPAD_RIGHT ? gp.DPAD_RIGHT = 1 : gp.DPAD_RIGHT = 0;
-
-			rep.buttons[2] & SwitchPro::Buttons2::ZL ? gp.ZL = 1 : gp.ZL = 0;
-			rep.buttons[0] & SwitchPro::Buttons0::ZR ? gp.ZR = 1 : gp.ZR = 0;
-
-			uint16_t lx = rep.joysticks[0] | ((rep.joysticks[1] & 0x0F) << 8);
-			uint16_t ly = (rep.joysticks[1] >> 4) | (rep.joysticks[2] << 4);
-			uint16_t rx = rep.joysticks[3] | ((rep.joysticks[4] & 0x0F) << 8);
-			uint16_t ry = (rep.joysticks[4] >> 4) | (rep.joysticks[5] << 4);
-
-			gp.LX = lx - 2048 - neutral_lx;
-			gp.LY = ly - 2048 - neutral_ly;
-			gp.RX = rx - 2048 - neutral_rx;
-			gp.RY = ry - 2048 - neutral_ry;
-			{
-				std::lock_guard<std::mutex> lock(mtx);
-				gamepad = gp;
-			}
+void SerialAnalizer::AddSink(SampleSink* sink) {
+	std::lock_guard<std::mutex> lock(sinkMtx);
+	sinks.push_back(sink);
+}
 
-			/*for (const auto& byte : in_report) {
-				std::cout << std::hex << std::setw(2) << std::setfill('0') << (int)byte << " ";
-			}
-			std::cout << std::dec << std::endl;*/
+void SerialAnalizer::RemoveSink(SampleSink* sink) {
+	std::lock_guard<std::mutex> lock(sinkMtx);
+	sinks.erase(std::remove(sinks.begin(), sinks.end(), sink), sinks.end());
+}
 
-		}
-		catch (std::exception& e) {
-			std::cerr << "Serial port read error: " << e.what() << std::endl;
-			running = false;
+void SerialAnalizer::ApplyFilter(SwitchPro::GamePad& gp, double t) {
+	auto toStick = [](int16_t x, int16_t y) {
+		return StickFilter::Stick{ x / 2048.0f, y / 2048.0f };
+	};
+	auto toAxis = [](float v) {
+		return (int16_t)std::max(-2048.0f, std::min(2047.0f, std::round(v * 2048.0f)));
+	};
+
+	// 差し替えが届いていれば取り込む (普段はロード1回だけ)
+	if (pendingFilter.load(std::memory_order_relaxed)) {
+		FilterPair* next = pendingFilter.exchange(nullptr, std::memory_order_acquire);
+		if (next) {
+			filterL = std::move(next->l);
+			filterR = std::move(next->r);
+			delete next;
 		}
 	}
+
+	StickFilter::Stick l = toStick(gp.LX, gp.LY);
+	StickFilter::Stick r = toStick(gp.RX, gp.RY);
+	filterL->Process(l, t);
+	filterR->Process(r, t);
+	gp.LX = toAxis(l.x);
+	gp.LY = toAxis(l.y);
+	gp.RX = toAxis(r.x);
+	gp.RY = toAxis(r.y);
+}
+
+void SerialAnalizer::SetStickFilter(const StickFilter::Filter& filter) {
+	FilterPair* next = new FilterPair{ filter.Clone(), filter.Clone() };
+	next->l->Reset();
+	next->r->Reset();
+	// 読み込みスレッドがまだ取り込んでいない前回の差し替えは捨てる
+	delete pendingFilter.exchange(next, std::memory_order_acq_rel);
 }
 
 SwitchPro::GamePad SerialAnalizer::GetGamePad() {
 	std::lock_guard<std::mutex> lock(mtx);
-	return gamepad;
+	return sample.pad;
+}
+
+SerialTuning::Report SerialAnalizer::GetTuning() {
+	std::lock_guard<std::mutex> lock(mtx);
+	return tuningReport;
+}
+
+GamePadSample SerialAnalizer::GetSample() {
+	std::lock_guard<std::mutex> lock(mtx);
+	return sample;
 }
\ No newline at end of file
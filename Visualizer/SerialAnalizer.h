@@ -2,123 +2,103 @@
 #include <asio.hpp>
 #include <string>
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "StickFilter.h"
+#include "DeviceClock.h"
+#include "SwitchPro.h"
+#include "FrameParser.h"
+#include "SerialTuning.h"
+#include "LatencyStats.h"
 
 
-namespace SwitchPro
-{
-    static constexpr uint8_t INFO_CONN_MASK = 0xAB;
-    static constexpr uint8_t INFO_BATTERY_MASK = 0x0F;
-
-    namespace CMD
-    {
-        static constexpr uint8_t HID = 0x80;
-        static constexpr uint8_t RUMBLE_ONLY = 0x10;
-        static constexpr uint8_t AND_RUMBLE = 0x01;
-        static constexpr uint8_t LED = 0x30;
-        static constexpr uint8_t LED_HOME = 0x38;
-        static constexpr uint8_t GYRO = 0x40;
-        static constexpr uint8_t MODE = 0x03;
-        static constexpr uint8_t FULL_REPORT_MODE = 0x30;
-        static constexpr uint8_t HANDSHAKE = 0x02;
-        static constexpr uint8_t DISABLE_TIMEOUT = 0x04;
-    }
-
-    namespace Buttons0
-    {
-        static constexpr uint8_t Y = 0x01;
-        static constexpr uint8_t X = 0x02;
-        static constexpr uint8_t B = 0x04;
-        static constexpr uint8_t A = 0x08;
-        static constexpr uint8_t R = 0x40;
-        static constexpr uint8_t ZR = 0x80;
-    };
-
-    namespace Buttons1
-    {
-        static constexpr uint8_t MINUS = 0x01;
-        static constexpr uint8_t PLUS = 0x02;
-        static constexpr uint8_t R3 = 0x04;
-        static constexpr uint8_t L3 = 0x08;
-        static constexpr uint8_t HOME = 0x10;
-        static constexpr uint8_t CAPTURE = 0x20;
-    };
-
-    namespace Buttons2
-    {
-        static constexpr uint8_t DPAD_DOWN = 0x01;
-        static constexpr uint8_t DPAD_UP = 0x02;
-        static constexpr uint8_t DPAD_RIGHT = 0x04;
-        static constexpr uint8_t DPAD_LEFT = 0x08;
-        static constexpr uint8_t L = 0x40;
-        static constexpr uint8_t ZL = 0x80;
-    };
-
-    struct InReport
-    {
-        uint8_t report_id;
-        uint8_t timer;
-        uint8_t info;
-        uint8_t buttons[3];
-        uint8_t joysticks[6];
-    };
-
-    struct GamePad
-    {
-        uint8_t A;
-		uint8_t B;
-		uint8_t X;
-		uint8_t Y;
-		uint8_t L;
-		uint8_t R;
-        uint8_t L3;
-		uint8_t R3;
-        uint8_t MINUS;
-		uint8_t PLUS;
-		uint8_t HOME;
-		uint8_t CAPTURE;
-		uint8_t DPAD_UP;
-		uint8_t DPAD_DOWN;
-		uint8_t DPAD_LEFT;
-		uint8_t DPAD_RIGHT;
-		uint8_t ZL;
-		uint8_t ZR;
-
-        int16_t LX;
-		int16_t LY;
-		int16_t RX;
-		int16_t RY;
-    };
-};
-
 class SerialAnalizer
 {
 public:
-	SerialAnalizer(const std::string portName);
+	SerialAnalizer(const std::string portName, const SerialTuning::Options& tuning = {});
 	~SerialAnalizer();
 
 	SwitchPro::GamePad GetGamePad();
+	GamePadSample GetSample();
+	// 受信したサンプルを読み込みスレッドから sink に渡す
+	// RemoveSink から戻った後は sink が呼ばれないので、破棄してよい
+	void AddSink(SampleSink* sink);
+	void RemoveSink(SampleSink* sink);
+
+	// スティックのフィルタを差し替える (L/R それぞれに複製して使う)
+	// 次のレポートから読み込みスレッドが取り込む
+	void SetStickFilter(const StickFilter::Filter& filter);
 	bool IsOpen() const { return port.is_open(); }
-    bool ReadOnce(int timeout_ms);
+	bool IsRunning() const { return running; }
+	// 低遅延モードで実際に得られた設定
+	SerialTuning::Report GetTuning();
+	// read_some から戻ってから publish し終えるまで (µs)
+	const LatencyStats& ReadLatency() const { return readLatency; }
+	// 推定取得時刻から publish まで (µs)。転送・バッファリングを含む、最小遅延からの超過分
+	const LatencyStats& DeviceLatency() const { return deviceLatency; }
+
+	static constexpr int NEUTRAL_REPORTS = 20;      // ニュートラルの平均を取るレポート数
+	static constexpr int NEUTRAL_TIMEOUT_MS = 500;  // 手動で開くときの待ち時間
+
+	// ポートを開いてフレームが届くか確認する (NEUTRAL_REPORTS 件読むか timeout_ms で返る)
+	// 成功したらポートを開いたまま、プローブ中に受け取ったレポートの平均をニュートラルにした SerialAnalizer を返す
+	// 読み込みスレッドは Start() で開始する。失敗したら nullptr
+	static SerialAnalizer* Probe(const std::string& portName, int timeout_ms, const SerialTuning::Options& tuning = {});
+	void Start();
+
+	// ポートを開かずに作る。受信データは Feed で渡す (ベンチマーク用)
+	static SerialAnalizer* CreateDetached(const SerialTuning::Options& tuning = {});
+	// 受信したバイト列からフレームを切り出し、デコードして公開する (読み込みスレッドと同じ処理)
+	void Feed(const uint8_t* data, size_t length, std::chrono::steady_clock::time_point arrival);
 
 private:
+	// Probe・CreateDetached 用。ポートは開かない
+	SerialAnalizer(const SerialTuning::Options& tuning);
+
+	static void ConfigurePort(asio::serial_port& port);
 	bool OpenSerialPort(std::string portName);
-    void CalcNeutral();
+	// timeout_ms までに NEUTRAL_REPORTS 件読んでニュートラルを決める。読めたレポート数を返す
+	int CalcNeutral(int timeout_ms);
 	void ReadLoop();
+	void HandleReport(const uint8_t* report, std::chrono::steady_clock::time_point arrival);
+	void ApplyFilter(SwitchPro::GamePad& gp, double t);
 
-    const uint8_t startByte = 0xAA;
-    const uint8_t endByte = 0xBB;
 
 	uint16_t neutral_lx = 0;
 	uint16_t neutral_ly = 0;
 	uint16_t neutral_rx = 0;
 	uint16_t neutral_ry = 0;
 
+	std::string portName;
 	asio::io_context io;
 	asio::serial_port port;
+	SwitchPro::FrameParser parser;
 	std::thread worker;
-	bool running = true;
+	std::atomic<bool> running{ true };
+
+	// filterL/filterR は読み込みスレッドだけが触る。差し替えは pendingFilter 経由で受け取る
+	struct FilterPair
+	{
+		std::unique_ptr<StickFilter::Filter> l;
+		std::unique_ptr<StickFilter::Filter> r;
+	};
+	std::atomic<FilterPair*> pendingFilter{ nullptr };
+	std::unique_ptr<StickFilter::Filter> filterL = StickFilter::Make(StickFilter::DefaultChain());
+	std::unique_ptr<StickFilter::Filter> filterR = StickFilter::Make(StickFilter::DefaultChain());
+
+	SerialTuning::Options tuning;
+	SerialTuning::Report tuningReport;
+	LatencyStats readLatency;
+	LatencyStats deviceLatency;
+
+	DeviceClock clock;
+	uint64_t seq = 0;
+
+	std::mutex sinkMtx;
+	std::vector<SampleSink*> sinks;
 
 	std::mutex mtx;
-    SwitchPro::GamePad gamepad = {};
+    GamePadSample sample = {};
 };
 
@@ -0,0 +1,181 @@
+﻿#include "SerialTuning.h"
+#include <sstream>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/serial.h>
+#endif
+
+
+std::string SerialTuning::Report::ToString() const {
+	std::ostringstream ss;
+	ss << "read: " << readMode;
+	if (asyncLowLatency >= 0) ss << ", low_latency: " << (asyncLowLatency ? "on" : "off");
+	if (latencyTimerMs >= 0) ss << ", latency_timer: " << latencyTimerMs << " ms";
+	ss << ", sched: " << scheduler;
+	if (priority != 0) ss << " " << priority;
+	if (cpu >= 0) ss << ", cpu: " << cpu;
+	if (memoryLocked) ss << ", mlock";
+	for (const auto& e : errors) ss << " [" << e << "]";
+	return ss.str();
+}
+
+#ifdef _WIN32
+
+void SerialTuning::ApplyPort(asio::serial_port& port, const std::string& portName, const Options& options, Report& report) {
+	if (!options.lowLatency) return;
+
+	// 受信済みのデータがあればすぐ返し、無ければ最初の1バイトが届いた時点で返す
+	// (既定のタイムアウト 0 はバッファが埋まるまで待つ)
+	// 定数タイムアウトで 0 バイト完了になると asio が EOF 扱いするので、実質無限にしておく
+	HANDLE handle = port.native_handle();
+	COMMTIMEOUTS timeouts = {};
+	timeouts.ReadIntervalTimeout = MAXDWORD;
+	timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+	timeouts.ReadTotalTimeoutConstant = MAXDWORD - 1;
+	if (!SetCommTimeouts(handle, &timeouts)) {
+		report.errors.push_back("SetCommTimeouts failed");
+	}
+	if (GetCommTimeouts(handle, &timeouts)) {
+		report.readMode = timeouts.ReadIntervalTimeout == MAXDWORD && timeouts.ReadTotalTimeoutMultiplier == MAXDWORD
+			? "first byte" : "interval " + std::to_string(timeouts.ReadIntervalTimeout) + " ms";
+	}
+	// FTDI のラッチタイマーはドライバのレジストリ設定なのでここでは変更しない
+}
+
+void SerialTuning::ApplyThread(const Options& options, Report& report) {
+	HANDLE thread = GetCurrentThread();
+	if (options.priority > 0) {
+		if (!SetThreadPriority(thread, THREAD_PRIORITY_TIME_CRITICAL)) {
+			report.errors.push_back("SetThreadPriority failed");
+		}
+	}
+	int priority = GetThreadPriority(thread);
+	report.scheduler = priority == THREAD_PRIORITY_TIME_CRITICAL ? "time critical" : "default";
+	report.priority = priority == THREAD_PRIORITY_NORMAL ? 0 : priority;
+
+	if (options.cpu >= 0) {
+		if (options.cpu >= 64 || !SetThreadAffinityMask(thread, DWORD_PTR(1) << options.cpu)) {
+			report.errors.push_back("SetThreadAffinityMask failed");
+		}
+		else {
+			report.cpu = options.cpu;
+		}
+	}
+
+	if (options.lockMemory) report.errors.push_back("memory locking is not supported");
+}
+
+void SerialTuning::Release(Report& report) {
+}
+
+#else
+
+namespace
+{
+	std::string ErrorText(const char* what) {
+		return std::string(what) + ": " + std::strerror(errno);
+	}
+
+	// /dev/ttyUSB0 → /sys/class/tty/ttyUSB0/device/latency_timer (ftdi_sio 等)
+	std::string LatencyTimerPath(const std::string& portName) {
+		char resolved[PATH_MAX];
+		if (!realpath(portName.c_str(), resolved)) return "";
+		std::string name = resolved;
+		name = name.substr(name.find_last_of('/') + 1);
+		return "/sys/class/tty/" + name + "/device/latency_timer";
+	}
+}
+
+void SerialTuning::ApplyPort(asio::serial_port& port, const std::string& portName, const Options& options, Report& report) {
+	if (!options.lowLatency) return;
+	int fd = port.native_handle();
+
+	// asio は O_NONBLOCK で開いてリアクタで待つので、VMIN/VTIME は読み込みに影響しない
+	// 届いた分は read_some がすぐ返す
+	report.readMode = "nonblocking";
+
+	// ドライバ側のバッファリングを減らす (pty 等は非対応)
+	serial_struct ss;
+	if (ioctl(fd, TIOCGSERIAL, &ss) == 0) {
+		ss.flags |= ASYNC_LOW_LATENCY;
+		if (ioctl(fd, TIOCSSERIAL, &ss) != 0) report.errors.push_back(ErrorText("TIOCSSERIAL"));
+		if (ioctl(fd, TIOCGSERIAL, &ss) == 0) report.asyncLowLatency = (ss.flags & ASYNC_LOW_LATENCY) ? 1 : 0;
+	}
+
+	// USBシリアルのラッチタイマー (既定 16ms) を 1ms にする。書き込みには権限が要る
+	std::string path = LatencyTimerPath(portName);
+	if (!path.empty() && access(path.c_str(), F_OK) == 0) {
+		{
+			std::ofstream out(path);
+			out << 1;
+			out.flush();
+			if (!out) report.errors.push_back("latency_timer not writable");
+		}
+		std::ifstream in(path);
+		int ms;
+		if (in >> ms) report.latencyTimerMs = ms;
+	}
+}
+
+void SerialTuning::ApplyThread(const Options& options, Report& report) {
+	pthread_t self = pthread_self();
+
+	if (options.priority > 0) {
+		sched_param param = {};
+		param.sched_priority = options.priority;
+		int err = pthread_setschedparam(self, SCHED_FIFO, &param);
+		if (err != 0) {
+			errno = err;
+			report.errors.push_back(ErrorText("SCHED_FIFO"));
+		}
+	}
+
+	// ページフォルトで止まらないようにする。プロセス全体に効くので明示的に指定されたときだけ
+	if (options.lockMemory) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) report.memoryLocked = true;
+		else report.errors.push_back(ErrorText("mlockall"));
+	}
+
+	int policy;
+	sched_param param;
+	if (pthread_getschedparam(self, &policy, &param) == 0) {
+		report.scheduler = policy == SCHED_FIFO ? "fifo" : policy == SCHED_RR ? "rr" : "default";
+		report.priority = param.sched_priority;
+	}
+
+	if (options.cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(options.cpu, &set);
+		int err = pthread_setaffinity_np(self, sizeof(set), &set);
+		if (err != 0) {
+			errno = err;
+			report.errors.push_back(ErrorText("affinity"));
+		}
+	}
+	cpu_set_t set;
+	if (pthread_getaffinity_np(self, sizeof(set), &set) == 0 && CPU_COUNT(&set) == 1) {
+		for (int i = 0; i < CPU_SETSIZE; ++i) {
+			if (CPU_ISSET(i, &set)) report.cpu = i;
+		}
+	}
+}
+
+void SerialTuning::Release(Report& report) {
+	if (!report.memoryLocked) return;
+	if (munlockall() == 0) report.memoryLocked = false;
+	else report.errors.push_back(ErrorText("munlockall"));
+}
+
+#endif
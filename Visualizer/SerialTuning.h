@@ -0,0 +1,38 @@
+﻿#pragma once
+#include <asio.hpp>
+#include <string>
+#include <vector>
+
+// 低遅延モード (オプトイン)
+// ポートの読み込み設定・USBシリアルのラッチタイマー・読み込みスレッドの優先度と CPU を調整する
+// 権限やドライバによって効かない設定があるので、実際に得られた値を Report に返す
+class SerialTuning
+{
+public:
+	struct Options {
+		bool lowLatency = false; // COMMTIMEOUTS (Windows), ASYNC_LOW_LATENCY, latency_timer
+		int priority = 0;        // 1-99: SCHED_FIFO (Windows は TIME_CRITICAL), 0: 変更しない
+		int cpu = -1;            // 読み込みスレッドを固定する CPU, -1: 固定しない
+		bool lockMemory = false; // プロセス全体のメモリを mlockall で固定する (Linux, ヘッドレス向け)
+	};
+
+	struct Report {
+		std::string readMode = "default";
+		int asyncLowLatency = -1;  // -1: 非対応, 0: 無効, 1: 有効
+		int latencyTimerMs = -1;   // -1: 不明
+		std::string scheduler = "default";
+		int priority = 0;
+		int cpu = -1;
+		bool memoryLocked = false;
+		std::vector<std::string> errors;
+
+		std::string ToString() const;
+	};
+
+	// ポートを開いた直後に呼ぶ
+	static void ApplyPort(asio::serial_port& port, const std::string& portName, const Options& options, Report& report);
+	// 読み込みスレッド自身から呼ぶ
+	static void ApplyThread(const Options& options, Report& report);
+	// ApplyThread で固定したメモリを解放する。読み込みスレッドを止めた後に呼ぶ
+	static void Release(Report& report);
+};
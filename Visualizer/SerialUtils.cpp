@@ -1,10 +1,26 @@
 ﻿#include "SerialUtils.h"
+#include <algorithm>
+#ifdef _WIN32
 #include <Windows.h>
 #include <SetupAPI.h>
 #include <devguid.h>
 #include <RegStr.h>
+#include <chrono>
+#else
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
 
 
+#ifdef _WIN32
+
 std::vector<SerialUtils::SerialPortInfo> SerialUtils::AvailablePorts() {
 	std::vector<SerialPortInfo> ports;
 
@@ -63,3 +79,171 @@ std::vector<SerialUtils::SerialPortInfo> SerialUtils::AvailablePorts() {
 
 	return ports;
 }
+
+SerialUtils::PortMonitor::PortMonitor(std::function<void()> onChange) : onChange(onChange) {
+	worker = std::thread(&PortMonitor::Run, this);
+}
+
+SerialUtils::PortMonitor::~PortMonitor() {
+	running = false;
+	if (worker.joinable()) worker.join();
+}
+
+void SerialUtils::PortMonitor::Run() {
+	// Windowsではポート名一覧をポーリングして差分を検出する
+	auto names = [] {
+		std::vector<std::string> v;
+		for (const auto& p : AvailablePorts()) v.push_back(p.port);
+		return v;
+	};
+	auto last = names();
+
+	int tick = 0;
+	while (running) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		if (++tick < 10) continue;
+		tick = 0;
+
+		auto now = names();
+		if (now != last) {
+			last = now;
+			onChange();
+		}
+	}
+}
+
+#else
+
+namespace
+{
+	// sysfs の属性ファイルを1行読む (末尾の改行は除く)
+	std::string ReadAttr(const std::string& path) {
+		char buf[256];
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) return {};
+		ssize_t n = ::read(fd, buf, sizeof(buf) - 1);
+		::close(fd);
+		if (n <= 0) return {};
+		while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == '\r')) --n;
+		return std::string(buf, n);
+	}
+
+	bool IsUsbSerialName(const char* name) {
+		return strncmp(name, "ttyUSB", 6) == 0 || strncmp(name, "ttyACM", 6) == 0;
+	}
+
+	bool IsNumber(const char* name) {
+		if (*name == '\0') return false;
+		for (; *name; ++name) {
+			if (*name < '0' || *name > '9') return false;
+		}
+		return true;
+	}
+}
+
+std::vector<SerialUtils::SerialPortInfo> SerialUtils::AvailablePorts() {
+	std::vector<SerialPortInfo> ports;
+
+	// USBシリアル (ttyUSB*, ttyACM*) を sysfs から列挙する
+	// デバイス自体は開かないので、使用中のポートにも影響しない
+	if (DIR* dir = opendir("/sys/class/tty")) {
+		while (dirent* ent = readdir(dir)) {
+			if (!IsUsbSerialName(ent->d_name)) continue;
+
+			SerialPortInfo info;
+			info.port = std::string("/dev/") + ent->d_name;
+			info.description = ent->d_name;
+
+			// device -> USBインターフェース。idVendor を持つ親ディレクトリがUSBデバイス
+			char real[PATH_MAX];
+			std::string link = std::string("/sys/class/tty/") + ent->d_name + "/device";
+			if (realpath(link.c_str(), real)) {
+				std::string usb = real;
+				for (int i = 0; i < 4 && !usb.empty(); ++i) {
+					std::string vid = ReadAttr(usb + "/idVendor");
+					if (!vid.empty()) {
+						info.vid = (uint16_t)strtoul(vid.c_str(), nullptr, 16);
+						info.pid = (uint16_t)strtoul(ReadAttr(usb + "/idProduct").c_str(), nullptr, 16);
+
+						std::string product = ReadAttr(usb + "/product");
+						std::string manufacturer = ReadAttr(usb + "/manufacturer");
+						char ids[16];
+						snprintf(ids, sizeof(ids), "%04X:%04X", info.vid, info.pid);
+						info.description = product.empty() ? manufacturer : product;
+						info.description += info.description.empty() ? ids : std::string(" ") + ids;
+						break;
+					}
+					usb.erase(usb.rfind('/'));
+				}
+			}
+			ports.push_back(info);
+		}
+		closedir(dir);
+	}
+
+	// 疑似端末 (/dev/pts/N)
+	if (DIR* dir = opendir("/dev/pts")) {
+		while (dirent* ent = readdir(dir)) {
+			if (!IsNumber(ent->d_name)) continue;
+
+			SerialPortInfo info;
+			info.port = std::string("/dev/pts/") + ent->d_name;
+			info.description = "pseudo terminal";
+			info.pseudo = true;
+			ports.push_back(info);
+		}
+		closedir(dir);
+	}
+
+	std::sort(ports.begin(), ports.end(), [](const SerialPortInfo& a, const SerialPortInfo& b) {
+		if (a.pseudo != b.pseudo) return !a.pseudo;
+		if (a.port.size() != b.port.size()) return a.port.size() < b.port.size();
+		return a.port < b.port;
+	});
+	return ports;
+}
+
+SerialUtils::PortMonitor::PortMonitor(std::function<void()> onChange) : onChange(onChange) {
+	// /dev と /dev/pts のノード作成・削除を inotify で監視する
+	notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (notifyFd < 0 || wakeFd < 0) return;
+
+	inotify_add_watch(notifyFd, "/dev", IN_CREATE | IN_DELETE | IN_ATTRIB);
+	inotify_add_watch(notifyFd, "/dev/pts", IN_CREATE | IN_DELETE);
+	worker = std::thread(&PortMonitor::Run, this);
+}
+
+SerialUtils::PortMonitor::~PortMonitor() {
+	running = false;
+	if (wakeFd >= 0) {
+		uint64_t one = 1;
+		(void)!::write(wakeFd, &one, sizeof(one));
+	}
+	if (worker.joinable()) worker.join();
+	if (notifyFd >= 0) ::close(notifyFd);
+	if (wakeFd >= 0) ::close(wakeFd);
+}
+
+void SerialUtils::PortMonitor::Run() {
+	alignas(inotify_event) char buf[4096];
+
+	while (running) {
+		pollfd fds[2] = { { notifyFd, POLLIN, 0 }, { wakeFd, POLLIN, 0 } };
+		if (poll(fds, 2, -1) < 0) continue;
+		if (fds[1].revents & POLLIN) break;
+
+		bool changed = false;
+		ssize_t len;
+		while ((len = ::read(notifyFd, buf, sizeof(buf))) > 0) {
+			for (char* p = buf; p < buf + len; p += sizeof(inotify_event) + ((inotify_event*)p)->len) {
+				auto* ev = (inotify_event*)p;
+				if (ev->len == 0) continue;
+				if (IsUsbSerialName(ev->name) || IsNumber(ev->name)) changed = true;
+			}
+		}
+		if (changed) onChange();
+	}
+}
+
+#endif
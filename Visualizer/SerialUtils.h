@@ -1,6 +1,10 @@
 ﻿#pragma once
 #include <vector>
 #include <string>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <cstdint>
 
 class SerialUtils
 {
@@ -8,8 +12,30 @@ public:
 	struct SerialPortInfo {
 		std::string port;
 		std::string description;
+		uint16_t vid = 0;
+		uint16_t pid = 0;
+		bool pseudo = false; // pty (シミュレータ等)
 	};
 
 	static std::vector<SerialPortInfo> AvailablePorts();
-};
 
+	// ポートの追加・削除を監視し、変化があればコールバックを呼ぶ
+	// コールバックは監視スレッドから呼ばれるので、UI更新は CallAfter 等で行うこと
+	class PortMonitor
+	{
+	public:
+		PortMonitor(std::function<void()> onChange);
+		~PortMonitor();
+
+	private:
+		void Run();
+
+		std::function<void()> onChange;
+		std::thread worker;
+		std::atomic<bool> running{ true };
+#ifndef _WIN32
+		int notifyFd = -1;
+		int wakeFd = -1;
+#endif
+	};
+};
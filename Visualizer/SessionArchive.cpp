@@ -0,0 +1,434 @@
+﻿#include "SessionArchive.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace SessionArchive
+{
+	static constexpr char FILE_MAGIC[8] = { 'I', 'V', 'S', 'E', 'S', 'S', '0', '1' };
+	static constexpr uint32_t FILE_VERSION = 1;
+	static constexpr uint32_t BLOCK_MAGIC = 0x4B425649; // "IVBK"
+	static constexpr uint32_t INDEX_MAGIC = 0x58495649; // "IVIX"
+	static constexpr int COLUMNS = 11;
+
+	static_assert(sizeof(FileHeader) == 32, "FileHeader layout");
+	static_assert(sizeof(BlockHeader) == 32, "BlockHeader layout");
+	static_assert(sizeof(IndexEntry) == 32, "IndexEntry layout");
+	static_assert(sizeof(Trailer) == 16, "Trailer layout");
+
+	// ====== 符号化 ======
+
+	static void PutVarint(std::vector<uint8_t>& out, uint64_t v) {
+		while (v >= 0x80) {
+			out.push_back((uint8_t)(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back((uint8_t)v);
+	}
+
+	static bool GetVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+		v = 0;
+		for (int shift = 0; shift < 64 && p < end; shift += 7) {
+			uint8_t b = *p++;
+			v |= (uint64_t)(b & 0x7F) << shift;
+			if (!(b & 0x80)) return true;
+		}
+		return false;
+	}
+
+	static uint64_t ZigZag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+	static int64_t UnZigZag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+	// 差分列。差分が 0 のときは続けて「さらに何個 0 が続くか」を書く
+	template <typename Get>
+	static void EncodeDelta(std::vector<uint8_t>& out, size_t count, Get get) {
+		int64_t prev = 0;
+		for (size_t i = 0; i < count;) {
+			int64_t v = get(i);
+			int64_t d = v - prev;
+			PutVarint(out, ZigZag(d));
+			++i;
+			if (d == 0) {
+				size_t run = 0;
+				while (i < count && get(i) == prev) {
+					++run;
+					++i;
+				}
+				PutVarint(out, run);
+			}
+			prev = v;
+		}
+	}
+
+	template <typename Set>
+	static bool DecodeDelta(const uint8_t* p, const uint8_t* end, size_t count, Set set) {
+		int64_t prev = 0;
+		for (size_t i = 0; i < count;) {
+			uint64_t zz;
+			if (!GetVarint(p, end, zz)) return false;
+			int64_t d = UnZigZag(zz);
+			prev += d;
+			set(i++, prev);
+			if (d == 0) {
+				uint64_t run;
+				if (!GetVarint(p, end, run) || run > count - i) return false;
+				for (; run > 0; --run) set(i++, prev);
+			}
+		}
+		return true;
+	}
+
+	void EncodeBlock(const Sample* samples, size_t count, std::vector<uint8_t>& out) {
+		out.clear();
+		std::vector<uint8_t> column;
+
+		auto put = [&](auto encode) {
+			column.clear();
+			encode(column);
+			PutVarint(out, column.size());
+			out.insert(out.end(), column.begin(), column.end());
+		};
+
+		put([&](std::vector<uint8_t>& c) { EncodeDelta(c, count, [&](size_t i) { return samples[i].timeUs; }); });
+		put([&](std::vector<uint8_t>& c) { EncodeDelta(c, count, [&](size_t i) { return (int64_t)samples[i].ticks; }); });
+
+		// ボタンは (マスク, 連続数)
+		put([&](std::vector<uint8_t>& c) {
+			for (size_t i = 0; i < count;) {
+				size_t run = 1;
+				while (i + run < count && samples[i + run].buttons == samples[i].buttons) ++run;
+				PutVarint(c, samples[i].buttons);
+				PutVarint(c, run);
+				i += run;
+			}
+		});
+
+		for (int a = 0; a < 4; ++a) {
+			put([&](std::vector<uint8_t>& c) { EncodeDelta(c, count, [&](size_t i) { return (int64_t)samples[i].axis[a]; }); });
+		}
+		for (int a = 0; a < 4; ++a) {
+			put([&](std::vector<uint8_t>& c) { EncodeDelta(c, count, [&](size_t i) { return (int64_t)samples[i].raw[a]; }); });
+		}
+	}
+
+	bool DecodeBlock(const uint8_t* data, size_t size, size_t count, std::vector<Sample>& out) {
+		out.resize(count);
+		const uint8_t* p = data;
+		const uint8_t* end = data + size;
+
+		for (int col = 0; col < COLUMNS; ++col) {
+			uint64_t len;
+			if (!GetVarint(p, end, len) || len > (uint64_t)(end - p)) return false;
+			const uint8_t* cend = p + len;
+			bool ok = true;
+
+			if (col == 0) {
+				ok = DecodeDelta(p, cend, count, [&](size_t i, int64_t v) { out[i].timeUs = v; });
+			}
+			else if (col == 1) {
+				ok = DecodeDelta(p, cend, count, [&](size_t i, int64_t v) { out[i].ticks = (uint64_t)v; });
+			}
+			else if (col == 2) {
+				const uint8_t* q = p;
+				for (size_t i = 0; i < count && ok;) {
+					uint64_t mask, run;
+					ok = GetVarint(q, cend, mask) && GetVarint(q, cend, run) && run > 0 && run <= count - i;
+					for (; ok && run > 0; --run) out[i++].buttons = (uint32_t)mask;
+				}
+			}
+			else if (col < 7) {
+				int a = col - 3;
+				ok = DecodeDelta(p, cend, count, [&](size_t i, int64_t v) { out[i].axis[a] = (int16_t)v; });
+			}
+			else {
+				int a = col - 7;
+				ok = DecodeDelta(p, cend, count, [&](size_t i, int64_t v) { out[i].raw[a] = (uint16_t)v; });
+			}
+			if (!ok) return false;
+			p = cend;
+		}
+		return true;
+	}
+
+	SwitchPro::GamePad Sample::ToGamePad() const {
+		SwitchPro::GamePad gp = {};
+		SwitchPro::ApplyButtonMask(buttons, gp);
+		gp.LX = axis[0];
+		gp.LY = axis[1];
+		gp.RX = axis[2];
+		gp.RY = axis[3];
+		return gp;
+	}
+
+
+	// ====== Writer ======
+
+	Writer::~Writer() {
+		Close();
+	}
+
+	bool Writer::Open(const std::string& path) {
+		if (file) return false;
+		file = fopen(path.c_str(), "wb");
+		if (!file) return false;
+
+		FileHeader h = {};
+		memcpy(h.magic, FILE_MAGIC, sizeof(h.magic));
+		h.version = FILE_VERSION;
+		h.blockSamples = BLOCK_SAMPLES;
+		h.startEpochUs = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		if (fwrite(&h, sizeof(h), 1, file) != 1) {
+			fclose(file);
+			file = nullptr;
+			return false;
+		}
+		offset = sizeof(h);
+		failed = false;
+
+		block.reserve(BLOCK_SAMPLES);
+		running = true;
+		worker = std::thread(&Writer::Run, this);
+		return true;
+	}
+
+	void Writer::Close() {
+		if (!file) return;
+		running = false;
+		if (worker.joinable()) worker.join();
+		Drain();
+		FlushBlock();
+
+		// 失敗後は書きかけのブロックが残っていて offset が合わないので、トレーラを書かない
+		// (Reader は完全なブロックだけを辿ってインデックスを作り直す)
+		if (!failed) {
+			Trailer t = {};
+			t.indexOffset = offset;
+			t.blockCount = (uint32_t)index.size();
+			t.magic = INDEX_MAGIC;
+			bool ok = (index.empty() || fwrite(index.data(), sizeof(IndexEntry), index.size(), file) == index.size())
+				&& fwrite(&t, sizeof(t), 1, file) == 1;
+			if (!ok) failed = true;
+		}
+		if (fclose(file) != 0) failed = true;
+		file = nullptr;
+	}
+
+	void Writer::OnSample(const GamePadSample& sample) {
+		// 読み込みスレッドからはキューに積むだけ
+		if (!started) {
+			origin = sample.captured;
+			started = true;
+		}
+		Sample s;
+		s.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(sample.captured - origin).count();
+		s.ticks = sample.deviceTicks;
+		s.buttons = SwitchPro::ButtonMask(sample.pad);
+		s.axis[0] = sample.pad.LX;
+		s.axis[1] = sample.pad.LY;
+		s.axis[2] = sample.pad.RX;
+		s.axis[3] = sample.pad.RY;
+		std::copy(sample.raw, sample.raw + 4, s.raw);
+
+		if (!queue.Push(s)) ++dropped;
+	}
+
+	void Writer::Run() {
+		while (running) {
+			Drain();
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+	}
+
+	void Writer::Drain() {
+		Sample s;
+		while (queue.Pop(s)) {
+			block.push_back(s);
+			if (block.size() == BLOCK_SAMPLES) FlushBlock();
+		}
+	}
+
+	void Writer::FlushBlock() {
+		if (block.empty()) return;
+		if (failed) {
+			dropped += block.size();
+			block.clear();
+			return;
+		}
+		EncodeBlock(block.data(), block.size(), encoded);
+
+		BlockHeader h = {};
+		h.magic = BLOCK_MAGIC;
+		h.count = (uint32_t)block.size();
+		h.size = (uint32_t)encoded.size();
+		h.firstUs = block.front().timeUs;
+		h.lastUs = block.back().timeUs;
+		bool ok = fwrite(&h, sizeof(h), 1, file) == 1
+			&& fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size()
+			&& fflush(file) == 0;
+		if (!ok) {
+			// 書けなかったブロックはインデックスに載せない
+			failed = true;
+			dropped += block.size();
+			block.clear();
+			return;
+		}
+
+		index.push_back({ h.firstUs, h.lastUs, offset, h.count, 0 });
+		offset += sizeof(h) + encoded.size();
+		written += block.size();
+		block.clear();
+	}
+
+
+	// ====== Reader ======
+
+	Reader::~Reader() {
+		Close();
+	}
+
+	bool Reader::Open(const std::string& path) {
+		Close();
+#ifdef _WIN32
+		HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (f == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER li;
+		if (!GetFileSizeEx(f, &li) || li.QuadPart == 0) {
+			CloseHandle(f);
+			return false;
+		}
+		HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!m) {
+			CloseHandle(f);
+			return false;
+		}
+		fileHandle = f;
+		mapHandle = m;
+		size = (size_t)li.QuadPart;
+		data = (const uint8_t*)MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+#else
+		fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) < 0 || st.st_size == 0) {
+			Close();
+			return false;
+		}
+		size = (size_t)st.st_size;
+		void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		data = p == MAP_FAILED ? nullptr : (const uint8_t*)p;
+#endif
+		if (!data || size < sizeof(FileHeader)) {
+			Close();
+			return false;
+		}
+
+		memcpy(&header, data, sizeof(header));
+		if (memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != FILE_VERSION) {
+			Close();
+			return false;
+		}
+
+		// トレーラが壊れていなければインデックスをそのまま使う
+		Trailer t = {};
+		bool indexed = false;
+		if (size >= sizeof(FileHeader) + sizeof(Trailer)) {
+			memcpy(&t, data + size - sizeof(t), sizeof(t));
+			indexed = t.magic == INDEX_MAGIC
+				&& t.indexOffset >= sizeof(FileHeader)
+				&& t.indexOffset + (uint64_t)t.blockCount * sizeof(IndexEntry) + sizeof(Trailer) == size;
+		}
+		if (indexed) {
+			index.resize(t.blockCount);
+			if (t.blockCount) memcpy(index.data(), data + t.indexOffset, t.blockCount * sizeof(IndexEntry));
+		}
+		else if (!RebuildIndex()) {
+			Close();
+			return false;
+		}
+
+		samples = 0;
+		for (const auto& e : index) samples += e.count;
+		return true;
+	}
+
+	void Reader::Close() {
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapHandle) CloseHandle((HANDLE)mapHandle);
+		if (fileHandle) CloseHandle((HANDLE)fileHandle);
+		mapHandle = nullptr;
+		fileHandle = nullptr;
+#else
+		if (data) munmap((void*)data, size);
+		if (fd >= 0) ::close(fd);
+		fd = -1;
+#endif
+		data = nullptr;
+		size = 0;
+		index.clear();
+		samples = 0;
+		cachedBlock = (size_t)-1;
+		cache.clear();
+	}
+
+	bool Reader::RebuildIndex() {
+		// 書き込み途中で終わったファイル。完全なブロックだけを先頭から辿る
+		index.clear();
+		uint64_t pos = sizeof(FileHeader);
+		while (pos + sizeof(BlockHeader) <= size) {
+			BlockHeader h;
+			memcpy(&h, data + pos, sizeof(h));
+			// 件数がヘッダーのブロック長を超えるもの・データがファイル末尾を越えるものは壊れている
+			if (h.magic != BLOCK_MAGIC || h.count > header.blockSamples || h.size > size - pos - sizeof(h)) break;
+			index.push_back({ h.firstUs, h.lastUs, pos, h.count, 0 });
+			pos += sizeof(h) + h.size;
+		}
+		return true;
+	}
+
+	size_t Reader::FindBlock(int64_t timeUs) const {
+		auto it = std::upper_bound(index.begin(), index.end(), timeUs,
+			[](int64_t t, const IndexEntry& e) { return t < e.firstUs; });
+		return it == index.begin() ? 0 : (size_t)(it - index.begin()) - 1;
+	}
+
+	bool Reader::ReadBlock(size_t i, std::vector<Sample>& out) const {
+		if (i >= index.size()) return false;
+		// インデックスもブロックヘッダーも信用せず、デコード前に範囲と件数を確かめる
+		const uint64_t offset = index[i].offset;
+		if (offset > size || size - offset < sizeof(BlockHeader)) return false;
+		BlockHeader h;
+		memcpy(&h, data + offset, sizeof(h));
+		if (h.magic != BLOCK_MAGIC || h.count > header.blockSamples || h.count != index[i].count) return false;
+		if (h.size > size - offset - sizeof(h)) return false;
+		return DecodeBlock(data + offset + sizeof(h), h.size, h.count, out);
+	}
+
+	bool Reader::Seek(int64_t timeUs, Sample& out) {
+		if (index.empty()) return false;
+		size_t b = FindBlock(timeUs);
+		if (b != cachedBlock) {
+			if (!ReadBlock(b, cache)) {
+				cachedBlock = (size_t)-1;
+				return false;
+			}
+			cachedBlock = b;
+		}
+		if (cache.empty()) return false;
+
+		auto it = std::upper_bound(cache.begin(), cache.end(), timeUs,
+			[](int64_t t, const Sample& s) { return t < s.timeUs; });
+		out = it == cache.begin() ? cache.front() : *(it - 1);
+		return true;
+	}
+};
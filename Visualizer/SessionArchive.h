@@ -0,0 +1,160 @@
+﻿#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SwitchPro.h"
+#include "RingBuffer.h"
+
+// セッションの記録ファイル (.ivs)
+//
+// [ファイルヘッダ] [ブロック] [ブロック] ... [インデックス] [トレーラ]
+// ブロックは最大 BLOCK_SAMPLES 件のサンプルを列ごとに格納する
+//   時刻・tick・各軸: 先頭は絶対値、以降は差分 (zigzag + varint)。差分 0 の連続は長さで表す
+//   ボタン: (マスク, 連続数) の組
+// インデックスは各ブロックの時刻範囲と位置。書き込み途中で終了した場合はブロックを順に辿って復元する
+namespace SessionArchive
+{
+	static constexpr uint32_t BLOCK_SAMPLES = 4096;
+
+	// 記録される1サンプル
+	struct Sample
+	{
+		int64_t timeUs;        // セッション開始からの取得時刻 (µs)
+		uint64_t ticks;        // デバイスのタイマー (展開済み)
+		uint32_t buttons;      // SwitchPro::ButtonMask
+		int16_t axis[4];       // LX, LY, RX, RY (補正・フィルタ済み)
+		uint16_t raw[4];       // LX, LY, RX, RY の生値
+
+		SwitchPro::GamePad ToGamePad() const;
+	};
+
+	struct FileHeader
+	{
+		char magic[8];         // "IVSESS01"
+		uint32_t version;
+		uint32_t blockSamples;
+		int64_t startEpochUs;  // 記録開始時の壁時計 (UNIX時間, µs)
+		uint64_t reserved;
+	};
+
+	struct BlockHeader
+	{
+		uint32_t magic;        // 'IVBK'
+		uint32_t count;
+		uint32_t size;         // 続く列データのバイト数
+		uint32_t reserved;
+		int64_t firstUs;
+		int64_t lastUs;
+	};
+
+	struct IndexEntry
+	{
+		int64_t firstUs;
+		int64_t lastUs;
+		uint64_t offset;       // BlockHeader の位置
+		uint32_t count;
+		uint32_t reserved;
+	};
+
+	struct Trailer
+	{
+		uint64_t indexOffset;
+		uint32_t blockCount;
+		uint32_t magic;        // 'IVIX'
+	};
+
+	void EncodeBlock(const Sample* samples, size_t count, std::vector<uint8_t>& out);
+	bool DecodeBlock(const uint8_t* data, size_t size, size_t count, std::vector<Sample>& out);
+
+
+	// SerialAnalizer から受け取ったサンプルを別スレッドでブロックに詰めて書き出す
+	class Writer : public SampleSink
+	{
+	public:
+		Writer() = default;
+		~Writer();
+
+		bool Open(const std::string& path);
+		void Close();
+		bool IsOpen() const { return file != nullptr; }
+
+		void OnSample(const GamePadSample& sample) override;
+
+		uint64_t Written() const { return written; }
+		uint64_t Dropped() const { return dropped; }
+		// 書き込みに失敗した。以降のサンプルは捨て、Close でもインデックスを書かない
+		bool Failed() const { return failed; }
+
+	private:
+		void Run();
+		void Drain();
+		void FlushBlock();
+
+		FILE* file = nullptr;
+		std::thread worker;
+		std::atomic<bool> running{ false };
+
+		SpscRing<Sample, 8192> queue;
+		bool started = false;
+		std::chrono::steady_clock::time_point origin;
+
+		std::vector<Sample> block;
+		std::vector<uint8_t> encoded;
+		std::vector<IndexEntry> index;
+		uint64_t offset = 0;
+
+		std::atomic<uint64_t> written{ 0 };
+		std::atomic<uint64_t> dropped{ 0 };
+		std::atomic<bool> failed{ false };
+	};
+
+
+	// メモリマップで開き、インデックスを二分探索して必要なブロックだけを展開する
+	class Reader
+	{
+	public:
+		Reader() = default;
+		~Reader();
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+
+		bool Open(const std::string& path);
+		void Close();
+
+		size_t BlockCount() const { return index.size(); }
+		const IndexEntry& Block(size_t i) const { return index[i]; }
+		uint64_t SampleCount() const { return samples; }
+		int64_t StartUs() const { return index.empty() ? 0 : index.front().firstUs; }
+		int64_t EndUs() const { return index.empty() ? 0 : index.back().lastUs; }
+		int64_t StartEpochUs() const { return header.startEpochUs; }
+
+		// 時刻 timeUs を含む (またはその直前の) ブロック番号
+		size_t FindBlock(int64_t timeUs) const;
+		bool ReadBlock(size_t i, std::vector<Sample>& out) const;
+		// timeUs 以前で最も新しいサンプル
+		bool Seek(int64_t timeUs, Sample& out);
+
+	private:
+		bool RebuildIndex();
+
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		void* fileHandle = nullptr;
+		void* mapHandle = nullptr;
+#else
+		int fd = -1;
+#endif
+
+		FileHeader header = {};
+		std::vector<IndexEntry> index;
+		uint64_t samples = 0;
+
+		// Seek 用に直前に展開したブロックを保持する
+		size_t cachedBlock = (size_t)-1;
+		std::vector<Sample> cache;
+	};
+};
@@ -0,0 +1,249 @@
+﻿#pragma once
+#include <cmath>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <utility>
+
+
+// スティック入力のフィルタ (デッドゾーン, カーブ, ヒステリシス, 平滑化)
+// 値は -1.0 ～ 1.0 に正規化した座標、t は秒単位の時刻
+namespace StickFilter
+{
+    struct Stick
+    {
+        float x;
+        float y;
+    };
+
+    // 半径が inner 未満なら 0 にする (従来の DrawPanel と同じ挙動)
+    struct RadialDeadzone
+    {
+        float inner = 0.05f;
+
+        void Process(Stick& s, double) const {
+            if (s.x * s.x + s.y * s.y < inner * inner) s = { 0, 0 };
+        }
+        void Reset() {}
+    };
+
+    // 軸ごとにデッドゾーンを適用する
+    struct AxialDeadzone
+    {
+        float inner = 0.05f;
+
+        void Process(Stick& s, double) const {
+            if (std::fabs(s.x) < inner) s.x = 0;
+            if (std::fabs(s.y) < inner) s.y = 0;
+        }
+        void Reset() {}
+    };
+
+    // inner ～ outer の範囲を 0 ～ 1 に引き伸ばす (デッドゾーン端での飛びをなくす)
+    struct ScaledRadialDeadzone
+    {
+        float inner = 0.05f;
+        float outer = 0.95f;
+
+        void Process(Stick& s, double) const {
+            float r = std::sqrt(s.x * s.x + s.y * s.y);
+            if (r < inner) {
+                s = { 0, 0 };
+                return;
+            }
+            float scaled = std::fmin((r - inner) / (outer - inner), 1.0f);
+            s.x *= scaled / r;
+            s.y *= scaled / r;
+        }
+        void Reset() {}
+    };
+
+    // 半径に対する応答カーブ (exponent > 1 で中心付近が鈍くなる)
+    struct ResponseCurve
+    {
+        float exponent = 2.0f;
+
+        void Process(Stick& s, double) const {
+            float r = std::sqrt(s.x * s.x + s.y * s.y);
+            if (r <= 0) return;
+            float curved = std::pow(std::fmin(r, 1.0f), exponent);
+            s.x *= curved / r;
+            s.y *= curved / r;
+        }
+        void Reset() {}
+    };
+
+    // 前回の出力から threshold 以上動いたときだけ出力を更新する (微小なブレを抑える)
+    struct Hysteresis
+    {
+        float threshold = 0.01f;
+
+        void Process(Stick& s, double) {
+            float dx = s.x - last.x;
+            float dy = s.y - last.y;
+            if (!valid || dx * dx + dy * dy >= threshold * threshold) {
+                last = s;
+                valid = true;
+            }
+            s = last;
+        }
+        void Reset() { valid = false; }
+
+        Stick last = { 0, 0 };
+        bool valid = false;
+    };
+
+    // 指数移動平均
+    struct Ema
+    {
+        float alpha = 0.5f;
+
+        void Process(Stick& s, double) {
+            if (valid) {
+                state.x += alpha * (s.x - state.x);
+                state.y += alpha * (s.y - state.y);
+            }
+            else {
+                state = s;
+                valid = true;
+            }
+            s = state;
+        }
+        void Reset() { valid = false; }
+
+        Stick state = { 0, 0 };
+        bool valid = false;
+    };
+
+    // One Euro Filter (Casiez et al.)。速く動かすほどカットオフが上がり遅延が減る
+    struct OneEuro
+    {
+        float minCutoff = 1.0f;  // Hz
+        float beta = 0.01f;
+        float dCutoff = 1.0f;    // Hz
+
+        void Process(Stick& s, double t) {
+            if (!valid) {
+                prev = s;
+                deriv = { 0, 0 };
+                lastT = t;
+                valid = true;
+                return;
+            }
+            double dt = t - lastT;
+            lastT = t;
+            if (dt <= 0) {
+                s = prev;
+                return;
+            }
+
+            float ad = Alpha(dCutoff, dt);
+            deriv.x += ad * ((s.x - prev.x) / (float)dt - deriv.x);
+            deriv.y += ad * ((s.y - prev.y) / (float)dt - deriv.y);
+
+            float speed = std::sqrt(deriv.x * deriv.x + deriv.y * deriv.y);
+            float a = Alpha(minCutoff + beta * speed, dt);
+            prev.x += a * (s.x - prev.x);
+            prev.y += a * (s.y - prev.y);
+            s = prev;
+        }
+        void Reset() { valid = false; }
+
+        static float Alpha(float cutoff, double dt) {
+            float tau = 1.0f / (2.0f * 3.14159265f * cutoff);
+            return 1.0f / (1.0f + tau / (float)dt);
+        }
+
+        Stick prev = { 0, 0 };
+        Stick deriv = { 0, 0 };
+        double lastT = 0;
+        bool valid = false;
+    };
+
+
+    // コンパイル時に合成するフィルタ列。各段の Process はインライン展開される
+    template <typename... Filters>
+    class Chain
+    {
+    public:
+        Chain() = default;
+        Chain(Filters... filters) : filters(std::move(filters)...) {}
+
+        void Process(Stick& s, double t) {
+            std::apply([&](auto&... f) { (f.Process(s, t), ...); }, filters);
+        }
+        void Reset() {
+            std::apply([](auto&... f) { (f.Reset(), ...); }, filters);
+        }
+
+        template <size_t I>
+        auto& Get() { return std::get<I>(filters); }
+
+    private:
+        std::tuple<Filters...> filters;
+    };
+
+
+    // 実行時に差し替えるためのインターフェース
+    class Filter
+    {
+    public:
+        virtual ~Filter() = default;
+        virtual void Process(Stick& s, double t) = 0;
+        virtual void Reset() = 0;
+        virtual std::unique_ptr<Filter> Clone() const = 0;
+    };
+
+    // 任意のフィルタ (Chain を含む) を Filter として包む。仮想呼び出しは1サンプルにつき1回
+    template <typename F>
+    class Erased : public Filter
+    {
+    public:
+        Erased(F f) : f(std::move(f)) {}
+
+        void Process(Stick& s, double t) override { f.Process(s, t); }
+        void Reset() override { f.Reset(); }
+        std::unique_ptr<Filter> Clone() const override { return std::make_unique<Erased<F>>(f); }
+
+    private:
+        F f;
+    };
+
+    template <typename F>
+    std::unique_ptr<Filter> Make(F f) {
+        return std::make_unique<Erased<F>>(std::move(f));
+    }
+
+    // 既定のフィルタ列
+    using DefaultChain = Chain<RadialDeadzone>;
+
+    // 名前で選べるフィルタ列 (ヘッドレスの --filter と MainFrame のメニューで使う)
+    struct Preset
+    {
+        const char* name;
+        const char* label;
+        std::unique_ptr<Filter> (*create)();
+    };
+
+    inline const std::vector<Preset>& Presets() {
+        static const std::vector<Preset> presets = {
+            { "radial", "Radial deadzone", [] { return Make(DefaultChain()); } },
+            { "axial", "Axial deadzone", [] { return Make(Chain<AxialDeadzone>()); } },
+            { "scaled", "Scaled radial deadzone", [] { return Make(Chain<ScaledRadialDeadzone>()); } },
+            { "curve", "Scaled deadzone + response curve", [] { return Make(Chain<ScaledRadialDeadzone, ResponseCurve>()); } },
+            { "steady", "Radial deadzone + hysteresis", [] { return Make(Chain<RadialDeadzone, Hysteresis>()); } },
+            { "ema", "Radial deadzone + EMA", [] { return Make(Chain<RadialDeadzone, Ema>()); } },
+            { "one-euro", "Scaled deadzone + One Euro", [] { return Make(Chain<ScaledRadialDeadzone, OneEuro>()); } },
+        };
+        return presets;
+    }
+
+    // 名前が見つからなければ nullptr
+    inline std::unique_ptr<Filter> MakePreset(const std::string& name) {
+        for (const auto& p : Presets()) {
+            if (name == p.name) return p.create();
+        }
+        return nullptr;
+    }
+};
@@ -0,0 +1,179 @@
+﻿#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+
+namespace SwitchPro
+{
+    static constexpr uint8_t INFO_CONN_MASK = 0xAB;
+    static constexpr uint8_t INFO_BATTERY_MASK = 0x0F;
+
+    namespace CMD
+    {
+        static constexpr uint8_t HID = 0x80;
+        static constexpr uint8_t RUMBLE_ONLY = 0x10;
+        static constexpr uint8_t AND_RUMBLE = 0x01;
+        static constexpr uint8_t LED = 0x30;
+        static constexpr uint8_t LED_HOME = 0x38;
+        static constexpr uint8_t GYRO = 0x40;
+        static constexpr uint8_t MODE = 0x03;
+        static constexpr uint8_t FULL_REPORT_MODE = 0x30;
+        static constexpr uint8_t HANDSHAKE = 0x02;
+        static constexpr uint8_t DISABLE_TIMEOUT = 0x04;
+    }
+
+    namespace Buttons0
+    {
+        static constexpr uint8_t Y = 0x01;
+        static constexpr uint8_t X = 0x02;
+        static constexpr uint8_t B = 0x04;
+        static constexpr uint8_t A = 0x08;
+        static constexpr uint8_t R = 0x40;
+        static constexpr uint8_t ZR = 0x80;
+    };
+
+    namespace Buttons1
+    {
+        static constexpr uint8_t MINUS = 0x01;
+        static constexpr uint8_t PLUS = 0x02;
+        static constexpr uint8_t R3 = 0x04;
+        static constexpr uint8_t L3 = 0x08;
+        static constexpr uint8_t HOME = 0x10;
+        static constexpr uint8_t CAPTURE = 0x20;
+    };
+
+    namespace Buttons2
+    {
+        static constexpr uint8_t DPAD_DOWN = 0x01;
+        static constexpr uint8_t DPAD_UP = 0x02;
+        static constexpr uint8_t DPAD_RIGHT = 0x04;
+        static constexpr uint8_t DPAD_LEFT = 0x08;
+        static constexpr uint8_t L = 0x40;
+        static constexpr uint8_t ZL = 0x80;
+    };
+
+    struct InReport
+    {
+        uint8_t report_id;
+        uint8_t timer;
+        uint8_t info;
+        uint8_t buttons[3];
+        uint8_t joysticks[6];
+    };
+
+    struct GamePad
+    {
+        uint8_t A;
+		uint8_t B;
+		uint8_t X;
+		uint8_t Y;
+		uint8_t L;
+		uint8_t R;
+        uint8_t L3;
+		uint8_t R3;
+        uint8_t MINUS;
+		uint8_t PLUS;
+		uint8_t HOME;
+		uint8_t CAPTURE;
+		uint8_t DPAD_UP;
+		uint8_t DPAD_DOWN;
+		uint8_t DPAD_LEFT;
+		uint8_t DPAD_RIGHT;
+		uint8_t ZL;
+		uint8_t ZR;
+
+        int16_t LX;
+		int16_t LY;
+		int16_t RX;
+		int16_t RY;
+    };
+
+    // フレームから取り出したレポート (12バイト以上) を InReport に詰める
+    inline void Parse(const uint8_t* report, InReport& rep) {
+        rep.report_id = report[0];
+        rep.timer     = report[1];
+        rep.info      = report[2];
+        memcpy(rep.buttons, report + 3, sizeof(rep.buttons));
+        memcpy(rep.joysticks, report + 6, sizeof(rep.joysticks));
+    }
+
+    // 12bitのスティック値 (LX, LY, RX, RY) を取り出す
+    inline void UnpackSticks(const InReport& rep, uint16_t raw[4]) {
+        raw[0] = rep.joysticks[0] | ((rep.joysticks[1] & 0x0F) << 8);
+        raw[1] = (rep.joysticks[1] >> 4) | (rep.joysticks[2] << 4);
+        raw[2] = rep.joysticks[3] | ((rep.joysticks[4] & 0x0F) << 8);
+        raw[3] = (rep.joysticks[4] >> 4) | (rep.joysticks[5] << 4);
+    }
+
+    // ボタンを GamePad に展開する
+    inline void DecodeButtons(const InReport& rep, GamePad& gp) {
+        gp.A = (rep.buttons[0] & Buttons0::A) ? 1 : 0;
+        gp.B = (rep.buttons[0] & Buttons0::B) ? 1 : 0;
+        gp.X = (rep.buttons[0] & Buttons0::X) ? 1 : 0;
+        gp.Y = (rep.buttons[0] & Buttons0::Y) ? 1 : 0;
+        gp.L = (rep.buttons[2] & Buttons2::L) ? 1 : 0;
+        gp.R = (rep.buttons[0] & Buttons0::R) ? 1 : 0;
+        gp.L3 = (rep.buttons[1] & Buttons1::L3) ? 1 : 0;
+        gp.R3 = (rep.buttons[1] & Buttons1::R3) ? 1 : 0;
+        gp.MINUS = (rep.buttons[1] & Buttons1::MINUS) ? 1 : 0;
+        gp.PLUS = (rep.buttons[1] & Buttons1::PLUS) ? 1 : 0;
+        gp.HOME = (rep.buttons[1] & Buttons1::HOME) ? 1 : 0;
+        gp.CAPTURE = (rep.buttons[1] & Buttons1::CAPTURE) ? 1 : 0;
+
+        gp.DPAD_UP = (rep.buttons[2] & Buttons2::DPAD_UP) ? 1 : 0;
+        gp.DPAD_DOWN = (rep.buttons[2] & Buttons2::DPAD_DOWN) ? 1 : 0;
+        gp.DPAD_LEFT = (rep.buttons[2] & Buttons2::DPAD_LEFT) ? 1 : 0;
+        gp.DPAD_RIGHT = (rep.buttons[2] & Buttons2::DPAD_RIGHT) ? 1 : 0;
+
+        gp.ZL = (rep.buttons[2] & Buttons2::ZL) ? 1 : 0;
+        gp.ZR = (rep.buttons[0] & Buttons0::ZR) ? 1 : 0;
+    }
+
+    // ボタンをレポートと同じビット配置の24bitマスクにする (buttons[0] | buttons[1] << 8 | buttons[2] << 16)
+    inline uint32_t ButtonMask(const GamePad& gp) {
+        uint32_t b0 = (gp.A ? Buttons0::A : 0) | (gp.B ? Buttons0::B : 0) | (gp.X ? Buttons0::X : 0)
+            | (gp.Y ? Buttons0::Y : 0) | (gp.R ? Buttons0::R : 0) | (gp.ZR ? Buttons0::ZR : 0);
+        uint32_t b1 = (gp.MINUS ? Buttons1::MINUS : 0) | (gp.PLUS ? Buttons1::PLUS : 0) | (gp.R3 ? Buttons1::R3 : 0)
+            | (gp.L3 ? Buttons1::L3 : 0) | (gp.HOME ? Buttons1::HOME : 0) | (gp.CAPTURE ? Buttons1::CAPTURE : 0);
+        uint32_t b2 = (gp.DPAD_DOWN ? Buttons2::DPAD_DOWN : 0) | (gp.DPAD_UP ? Buttons2::DPAD_UP : 0)
+            | (gp.DPAD_RIGHT ? Buttons2::DPAD_RIGHT : 0) | (gp.DPAD_LEFT ? Buttons2::DPAD_LEFT : 0)
+            | (gp.L ? Buttons2::L : 0) | (gp.ZL ? Buttons2::ZL : 0);
+        return b0 | (b1 << 8) | (b2 << 16);
+    }
+
+    // ButtonMask のビット番号ごとのボタン名 (割り当てのないビットは空文字列)
+    static constexpr const char* BUTTON_NAMES[24] = {
+        "Y", "X", "B", "A", "", "", "R", "ZR",
+        "MINUS", "PLUS", "R3", "L3", "HOME", "CAPTURE", "", "",
+        "DOWN", "UP", "RIGHT", "LEFT", "", "", "L", "ZL",
+    };
+
+    // ButtonMask の逆変換
+    inline void ApplyButtonMask(uint32_t mask, GamePad& gp) {
+        InReport rep = {};
+        rep.buttons[0] = mask & 0xFF;
+        rep.buttons[1] = (mask >> 8) & 0xFF;
+        rep.buttons[2] = (mask >> 16) & 0xFF;
+        DecodeButtons(rep, gp);
+    }
+};
+
+// 受信したレポート1件分 (時刻付き)
+struct GamePadSample
+{
+	uint64_t seq;                                     // 受信順の通し番号
+	uint64_t deviceTicks;                             // 巻き戻りを展開したタイマー値
+	std::chrono::steady_clock::time_point arrival;    // ホストでの受信時刻
+	std::chrono::steady_clock::time_point captured;   // タイマーから補正した取得時刻
+	uint16_t raw[4];                                  // LX, LY, RX, RY の生値 (0～4095)
+	SwitchPro::GamePad pad;                           // ニュートラル補正・フィルタ済み
+};
+
+// 受信したサンプルを受け取る (SerialAnalizer の読み込みスレッドから呼ばれるので、ブロックしないこと)
+class SampleSink
+{
+public:
+	virtual ~SampleSink() = default;
+	virtual void OnSample(const GamePadSample& sample) = 0;
+};
@@ -0,0 +1,267 @@
+﻿#include "TimelinePanel.h"
+#include <wx/dcbuffer.h>
+#include <algorithm>
+
+
+namespace
+{
+	constexpr int AXIS_HEIGHT = 56;
+	constexpr int LANE_HEIGHT = 3;
+
+	// ボタンのレーン (上から順に表示)
+	const uint32_t LANES[] = {
+		SwitchPro::Buttons0::A,
+		SwitchPro::Buttons0::B,
+		SwitchPro::Buttons0::X,
+		SwitchPro::Buttons0::Y,
+		(uint32_t)SwitchPro::Buttons2::L << 16,
+		SwitchPro::Buttons0::R,
+		(uint32_t)SwitchPro::Buttons2::ZL << 16,
+		SwitchPro::Buttons0::ZR,
+		(uint32_t)SwitchPro::Buttons1::MINUS << 8,
+		(uint32_t)SwitchPro::Buttons1::PLUS << 8,
+		(uint32_t)SwitchPro::Buttons1::L3 << 8,
+		(uint32_t)SwitchPro::Buttons1::R3 << 8,
+		(uint32_t)SwitchPro::Buttons1::HOME << 8,
+		(uint32_t)SwitchPro::Buttons1::CAPTURE << 8,
+		(uint32_t)SwitchPro::Buttons2::DPAD_UP << 16,
+		(uint32_t)SwitchPro::Buttons2::DPAD_DOWN << 16,
+		(uint32_t)SwitchPro::Buttons2::DPAD_LEFT << 16,
+		(uint32_t)SwitchPro::Buttons2::DPAD_RIGHT << 16,
+	};
+	constexpr int LANE_COUNT = sizeof(LANES) / sizeof(LANES[0]);
+
+	// LX, LY, RX, RY (Lスティックは白系、Rスティックは黄色系)
+	const unsigned char AXIS_COLOR[4][3] = {
+		{ 255, 255, 255 },
+		{ 140, 140, 140 },
+		{ 255, 255, 0 },
+		{ 150, 150, 0 },
+	};
+
+	wxString FormatTime(int64_t us) {
+		int64_t s = us / 1000000;
+		return wxString::Format("%d:%02d:%02d", (int)(s / 3600), (int)(s / 60 % 60), (int)(s % 60));
+	}
+}
+
+
+TimelinePanel::TimelinePanel(wxWindow* parent) : wxPanel(parent, wxID_ANY), m_timer(this) {
+	SetBackgroundStyle(wxBG_STYLE_PAINT);
+	SetBackgroundColour(*wxBLACK);
+	SetMinSize(wxSize(-1, AXIS_HEIGHT + 2 + LANE_COUNT * LANE_HEIGHT));
+
+	Bind(wxEVT_PAINT, &TimelinePanel::OnPaint, this);
+	Bind(wxEVT_TIMER, &TimelinePanel::OnTimer, this, m_timer.GetId());
+	Bind(wxEVT_LEFT_DOWN, &TimelinePanel::OnMouse, this);
+	Bind(wxEVT_LEFT_UP, &TimelinePanel::OnMouse, this);
+	Bind(wxEVT_MOTION, &TimelinePanel::OnMouse, this);
+	Bind(wxEVT_MOUSE_CAPTURE_LOST, &TimelinePanel::OnCaptureLost, this);
+
+	m_timer.Start(100); // ライブのデータ取り込み
+}
+
+bool TimelinePanel::LoadSession(const std::string& path) {
+	SessionArchive::Reader reader;
+	if (!reader.Open(path)) return false;
+
+	// 読み込みながら要約を作る
+	m_pyramid.Clear();
+	std::vector<SessionArchive::Sample> block;
+	for (size_t i = 0; i < reader.BlockCount(); ++i) {
+		if (!reader.ReadBlock(i, block)) break;
+		for (const auto& s : block) m_pyramid.Append(s);
+	}
+
+	m_session = true;
+	m_hasCursor = m_pyramid.Size() > 0;
+	m_cursorUs = m_pyramid.StartUs();
+	m_renderedCount = (size_t)-1;
+	Refresh();
+	return true;
+}
+
+void TimelinePanel::CloseSession() {
+	m_session = false;
+	m_hasCursor = false;
+	m_pyramid.Clear();
+	m_renderedCount = (size_t)-1;
+	Refresh();
+}
+
+void TimelinePanel::ResetLive() {
+	SessionArchive::Sample s;
+	while (m_queue.Pop(s)) {}
+	m_liveStarted = false;
+	if (m_session) return;
+
+	m_hasCursor = false;
+	m_pyramid.Clear();
+	m_renderedCount = (size_t)-1;
+	Refresh();
+}
+
+bool TimelinePanel::GetCursorPad(SwitchPro::GamePad& gp) const {
+	if (!m_hasCursor || m_pyramid.Size() == 0) return false;
+
+	// カーソル時刻以前で最も新しいサンプル
+	size_t i = m_pyramid.LowerBound(m_cursorUs + 1);
+	gp = m_pyramid.PadAt(i == 0 ? 0 : i - 1);
+	return true;
+}
+
+void TimelinePanel::OnSample(const GamePadSample& sample) {
+	if (!m_liveStarted) {
+		m_origin = sample.captured;
+		m_liveStarted = true;
+	}
+	SessionArchive::Sample s;
+	s.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(sample.captured - m_origin).count();
+	s.ticks = sample.deviceTicks;
+	s.buttons = SwitchPro::ButtonMask(sample.pad);
+	s.axis[0] = sample.pad.LX;
+	s.axis[1] = sample.pad.LY;
+	s.axis[2] = sample.pad.RX;
+	s.axis[3] = sample.pad.RY;
+	std::copy(sample.raw, sample.raw + 4, s.raw);
+	m_queue.Push(s);
+}
+
+void TimelinePanel::OnTimer(wxTimerEvent& event) {
+	// セッション表示中はライブのデータを捨てる
+	SessionArchive::Sample s;
+	bool added = false;
+	while (m_queue.Pop(s)) {
+		if (m_session) continue;
+		m_pyramid.Append(s);
+		added = true;
+	}
+	if (!m_session && m_pyramid.Size() > LIVE_LIMIT) {
+		m_pyramid.DropFront(m_pyramid.Size() - LIVE_LIMIT / 2);
+		m_renderedCount = (size_t)-1;
+	}
+	if (added) Refresh();
+}
+
+int64_t TimelinePanel::XToTime(int x) const {
+	int w = std::max(GetClientSize().GetWidth(), 1);
+	int64_t span = m_pyramid.EndUs() - m_pyramid.StartUs();
+	x = std::max(0, std::min(x, w - 1));
+	return m_pyramid.StartUs() + span * x / w;
+}
+
+int TimelinePanel::TimeToX(int64_t t) const {
+	int w = GetClientSize().GetWidth();
+	int64_t span = std::max<int64_t>(m_pyramid.EndUs() - m_pyramid.StartUs(), 1);
+	return (int)((t - m_pyramid.StartUs()) * w / span);
+}
+
+void TimelinePanel::OnMouse(wxMouseEvent& event) {
+	if (m_pyramid.Size() == 0) return;
+
+	if (event.LeftDown()) {
+		m_dragging = true;
+		m_hasCursor = true;
+		CaptureMouse();
+	}
+	else if (event.LeftUp() && m_dragging) {
+		m_dragging = false;
+		if (HasCapture()) ReleaseMouse();
+		// ライブ中はボタンを離すと最新の入力の表示に戻る
+		if (!m_session) m_hasCursor = false;
+		Refresh();
+		return;
+	}
+	if (!m_dragging) return;
+
+	m_cursorUs = XToTime(event.GetX());
+	Refresh();
+}
+
+void TimelinePanel::OnCaptureLost(wxMouseCaptureLostEvent& event) {
+	m_dragging = false;
+	if (!m_session) m_hasCursor = false;
+}
+
+void TimelinePanel::Render(const wxSize& size) {
+	// ピクセル列ごとに [列の開始時刻, 終了時刻) の要約を引き、画像に直接描く
+	int w = size.GetWidth();
+	int h = size.GetHeight();
+	wxImage img(w, h, true);
+	unsigned char* data = img.GetData();
+
+	auto fill = [&](int x, int y0, int y1, const unsigned char* rgb) {
+		y0 = std::max(y0, 0);
+		y1 = std::min(y1, h - 1);
+		for (int y = y0; y <= y1; ++y) {
+			unsigned char* p = data + (y * w + x) * 3;
+			p[0] = rgb[0];
+			p[1] = rgb[1];
+			p[2] = rgb[2];
+		}
+	};
+	auto axisY = [](int v) {
+		return AXIS_HEIGHT / 2 - v * (AXIS_HEIGHT / 2 - 1) / 2048;
+	};
+
+	static const unsigned char grid[3] = { 40, 40, 40 };
+	static const unsigned char lane[3] = { 0, 200, 255 };
+	for (int x = 0; x < w; ++x) fill(x, AXIS_HEIGHT / 2, AXIS_HEIGHT / 2, grid);
+
+	size_t n = m_pyramid.Size();
+	for (int x = 0; x < w && n > 0; ++x) {
+		size_t i0 = m_pyramid.LowerBound(XToTime(x));
+		size_t i1 = x + 1 < w ? m_pyramid.LowerBound(XToTime(x + 1)) : n;
+		if (i1 <= i0) {
+			if (i0 >= n) continue;
+			i1 = i0 + 1;
+		}
+
+		LodPyramid::Summary s = m_pyramid.Query(i0, i1);
+		if (s.empty) continue;
+
+		for (int a = 0; a < 4; ++a) {
+			fill(x, axisY(s.max[a]), axisY(s.min[a]), AXIS_COLOR[a]);
+		}
+		for (int l = 0; l < LANE_COUNT; ++l) {
+			if (s.buttons & LANES[l]) {
+				int y = AXIS_HEIGHT + 2 + l * LANE_HEIGHT;
+				fill(x, y, y + LANE_HEIGHT - 2, lane);
+			}
+		}
+	}
+
+	m_bitmap = wxBitmap(img);
+	m_renderedCount = n;
+	m_renderedSize = size;
+}
+
+void TimelinePanel::OnPaint(wxPaintEvent& event) {
+	wxAutoBufferedPaintDC dc(this);
+	wxSize size = GetClientSize();
+	if (size.GetWidth() <= 0 || size.GetHeight() <= 0) return;
+
+	// データか大きさが変わったときだけ描き直す
+	if (m_renderedCount != m_pyramid.Size() || m_renderedSize != size) {
+		Render(size);
+	}
+	dc.DrawBitmap(m_bitmap, 0, 0);
+
+	dc.SetTextForeground(wxColour(160, 160, 160));
+	dc.SetFont(wxFont(7, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+	if (m_pyramid.Size() == 0) {
+		dc.DrawText(m_session ? "Empty session" : "No data", 4, 2);
+		return;
+	}
+
+	int64_t length = m_pyramid.EndUs() - m_pyramid.StartUs();
+	if (m_hasCursor) {
+		int x = TimeToX(m_cursorUs);
+		dc.SetPen(*wxRED_PEN);
+		dc.DrawLine(x, 0, x, size.GetHeight());
+		dc.DrawText(FormatTime(m_cursorUs - m_pyramid.StartUs()) + " / " + FormatTime(length), 4, 2);
+	}
+	else {
+		dc.DrawText(FormatTime(length), 4, 2);
+	}
+}
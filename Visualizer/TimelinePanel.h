@@ -0,0 +1,58 @@
+﻿#pragma once
+#include <wx/wx.h>
+#include <chrono>
+#include <string>
+#include "LodPyramid.h"
+#include "RingBuffer.h"
+#include "SessionArchive.h"
+
+// セッション全体のスティック軸とボタンを並べたタイムライン
+// ドラッグでカーソルを動かすと、DrawPanel がカーソル位置の入力を表示する
+// 描画は LodPyramid の要約をピクセル列ごとに引くので、コストはセッションの長さによらない
+class TimelinePanel : public wxPanel, public SampleSink
+{
+public:
+	TimelinePanel(wxWindow* parent);
+
+	// 記録済みのセッションを開く / 閉じてライブ表示に戻る
+	bool LoadSession(const std::string& path);
+	void CloseSession();
+	bool HasSession() const { return m_session; }
+	// 新しい接続の前に前回のライブ表示を捨てる。どの SerialAnalizer の sink でもないときに呼ぶ
+	void ResetLive();
+
+	// カーソル位置の入力 (スクラブ中でなければ false)
+	bool GetCursorPad(SwitchPro::GamePad& gp) const;
+
+	// 読み込みスレッドから呼ばれる。キューに積むだけ
+	void OnSample(const GamePadSample& sample) override;
+
+private:
+	void OnPaint(wxPaintEvent& event);
+	void OnTimer(wxTimerEvent& event);
+	void OnMouse(wxMouseEvent& event);
+	void OnCaptureLost(wxMouseCaptureLostEvent& event);
+
+	void Render(const wxSize& size);
+	int64_t XToTime(int x) const;
+	int TimeToX(int64_t t) const;
+
+	LodPyramid m_pyramid;
+	bool m_session = false;
+
+	// ライブ表示用 (生産者は読み込みスレッド)
+	// 上限を超えたら古い半分を捨てる (1kHz で約17分)
+	static constexpr size_t LIVE_LIMIT = (size_t)1 << 20;
+	SpscRing<SessionArchive::Sample, 4096> m_queue;
+	bool m_liveStarted = false;
+	std::chrono::steady_clock::time_point m_origin;
+
+	bool m_dragging = false;
+	bool m_hasCursor = false;
+	int64_t m_cursorUs = 0;
+
+	wxBitmap m_bitmap;
+	size_t m_renderedCount = (size_t)-1;
+	wxSize m_renderedSize;
+	wxTimer m_timer;
+};
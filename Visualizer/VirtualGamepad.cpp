@@ -0,0 +1,171 @@
+﻿#include "VirtualGamepad.h"
+#include <iostream>
+#ifdef __linux__
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/uinput.h>
+#endif
+
+
+VirtualGamepad::~VirtualGamepad() {
+	Close();
+}
+
+#ifdef __linux__
+
+namespace
+{
+	// evdev のボタン配置 (hid-nintendo と同じく位置基準: A は右、B は下)
+	struct ButtonMap
+	{
+		uint8_t SwitchPro::GamePad::* button;
+		uint16_t code;
+	};
+
+	const ButtonMap BUTTONS[] = {
+		{ &SwitchPro::GamePad::A, BTN_EAST },
+		{ &SwitchPro::GamePad::B, BTN_SOUTH },
+		{ &SwitchPro::GamePad::X, BTN_NORTH },
+		{ &SwitchPro::GamePad::Y, BTN_WEST },
+		{ &SwitchPro::GamePad::L, BTN_TL },
+		{ &SwitchPro::GamePad::R, BTN_TR },
+		{ &SwitchPro::GamePad::ZL, BTN_TL2 },
+		{ &SwitchPro::GamePad::ZR, BTN_TR2 },
+		{ &SwitchPro::GamePad::MINUS, BTN_SELECT },
+		{ &SwitchPro::GamePad::PLUS, BTN_START },
+		{ &SwitchPro::GamePad::HOME, BTN_MODE },
+		{ &SwitchPro::GamePad::CAPTURE, BTN_Z },
+		{ &SwitchPro::GamePad::L3, BTN_THUMBL },
+		{ &SwitchPro::GamePad::R3, BTN_THUMBR },
+	};
+
+	// 1レポートで出しうるイベント数 (ボタン + 軸4 + ハット2 + SYN)
+	constexpr size_t MAX_EVENTS = sizeof(BUTTONS) / sizeof(BUTTONS[0]) + 4 + 2 + 1;
+
+	// evdev の Y 軸は下向きが正
+	int AxisValue(int code, const SwitchPro::GamePad& gp) {
+		switch (code) {
+		case ABS_X: return gp.LX;
+		case ABS_Y: return -gp.LY;
+		case ABS_RX: return gp.RX;
+		case ABS_RY: return -gp.RY;
+		case ABS_HAT0X: return (gp.DPAD_RIGHT ? 1 : 0) - (gp.DPAD_LEFT ? 1 : 0);
+		case ABS_HAT0Y: return (gp.DPAD_DOWN ? 1 : 0) - (gp.DPAD_UP ? 1 : 0);
+		}
+		return 0;
+	}
+
+	const int AXES[] = { ABS_X, ABS_Y, ABS_RX, ABS_RY, ABS_HAT0X, ABS_HAT0Y };
+}
+
+bool VirtualGamepad::Open(const std::string& name) {
+	Close();
+	fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		std::cerr << "uinput open error: " << std::strerror(errno) << std::endl;
+		return false;
+	}
+
+	bool ok = ioctl(fd, UI_SET_EVBIT, EV_KEY) == 0 && ioctl(fd, UI_SET_EVBIT, EV_ABS) == 0;
+	for (const auto& b : BUTTONS) ok = ok && ioctl(fd, UI_SET_KEYBIT, b.code) == 0;
+
+	for (int code : AXES) {
+		uinput_abs_setup abs = {};
+		abs.code = code;
+		bool hat = code == ABS_HAT0X || code == ABS_HAT0Y;
+		abs.absinfo.minimum = hat ? -1 : -2048;
+		abs.absinfo.maximum = hat ? 1 : 2047;
+		ok = ok && ioctl(fd, UI_SET_ABSBIT, code) == 0 && ioctl(fd, UI_ABS_SETUP, &abs) == 0;
+	}
+
+	uinput_setup setup = {};
+	setup.id.bustype = BUS_VIRTUAL;
+	setup.id.vendor = 0x057e;   // Nintendo
+	setup.id.product = 0x2009;  // Pro Controller
+	setup.id.version = 1;
+	std::strncpy(setup.name, name.c_str(), UINPUT_MAX_NAME_SIZE - 1);
+	ok = ok && ioctl(fd, UI_DEV_SETUP, &setup) == 0 && ioctl(fd, UI_DEV_CREATE) == 0;
+
+	if (!ok) {
+		std::cerr << "uinput setup error: " << std::strerror(errno) << std::endl;
+		close(fd);
+		fd = -1;
+		return false;
+	}
+
+	// sysfs の inputN の下にある eventN から /dev/input/eventN を求める
+	char sysname[64] = {};
+	if (ioctl(fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) >= 0) {
+		std::string dir = std::string("/sys/devices/virtual/input/") + sysname;
+		if (DIR* d = opendir(dir.c_str())) {
+			while (dirent* e = readdir(d)) {
+				if (std::strncmp(e->d_name, "event", 5) == 0) devicePath = std::string("/dev/input/") + e->d_name;
+			}
+			closedir(d);
+		}
+	}
+	hasLast = false;
+	return true;
+}
+
+void VirtualGamepad::Close() {
+	if (fd < 0) return;
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+	fd = -1;
+	devicePath.clear();
+}
+
+void VirtualGamepad::OnSample(const GamePadSample& sample) {
+	if (fd < 0) return;
+
+	input_event events[MAX_EVENTS];
+	size_t n = 0;
+	auto push = [&](uint16_t type, uint16_t code, int value) {
+		input_event& ev = events[n++];
+		std::memset(&ev, 0, sizeof(ev));
+		ev.type = type;
+		ev.code = code;
+		ev.value = value;
+	};
+
+	// 変化したものだけを出す (最初の1回は全部)
+	const SwitchPro::GamePad& gp = sample.pad;
+	for (const auto& b : BUTTONS) {
+		if (!hasLast || gp.*b.button != last.*b.button) push(EV_KEY, b.code, gp.*b.button ? 1 : 0);
+	}
+	for (int code : AXES) {
+		int value = AxisValue(code, gp);
+		if (!hasLast || value != AxisValue(code, last)) push(EV_ABS, code, value);
+	}
+	last = gp;
+	hasLast = true;
+	if (n == 0) return;
+	push(EV_SYN, SYN_REPORT, 0);
+
+	// 1回の write で SYN までまとめて渡す (ノンブロッキング。溢れたら捨てる)
+	ssize_t size = (ssize_t)(n * sizeof(input_event));
+	if (write(fd, events, size) != size) {
+		// 次のサンプルで全部出し直す
+		hasLast = false;
+		return;
+	}
+	latency.Add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sample.arrival).count());
+}
+
+#else
+
+bool VirtualGamepad::Open(const std::string& name) {
+	std::cerr << "uinput is only available on Linux" << std::endl;
+	return false;
+}
+
+void VirtualGamepad::Close() {
+}
+
+void VirtualGamepad::OnSample(const GamePadSample& sample) {
+}
+
+#endif
@@ -0,0 +1,34 @@
+﻿#pragma once
+#include <string>
+#include "SwitchPro.h"
+#include "LatencyStats.h"
+
+// 受信した入力を uinput の仮想ゲームパッドとして再公開する (Linux のみ)
+// ゲームや他のツールからは標準の evdev デバイスとして見える
+//
+// 読み込みスレッドから直接、変化したボタン・軸だけを1回の write で EV_SYN ごとまとめて書く
+class VirtualGamepad : public SampleSink
+{
+public:
+	VirtualGamepad() = default;
+	~VirtualGamepad();
+
+	// /dev/uinput への書き込み権限が要る。失敗したら false (Windows では常に false)
+	bool Open(const std::string& name = "Input Visualizer Pro Controller");
+	void Close();
+	bool IsOpen() const { return fd >= 0; }
+	// 作成された evdev デバイス (/dev/input/eventN)。分からなければ空
+	std::string DevicePath() const { return devicePath; }
+
+	void OnSample(const GamePadSample& sample) override;
+
+	// read_some から戻ってから write が終わるまで (µs)
+	const LatencyStats& Latency() const { return latency; }
+
+private:
+	int fd = -1;
+	std::string devicePath;
+	bool hasLast = false;
+	SwitchPro::GamePad last = {};
+	LatencyStats latency;
+};
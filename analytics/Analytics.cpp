@@ -0,0 +1,505 @@
+﻿// 記録セッション (.ivs) のディレクトリをまとめて集計する
+// セッションごとと全体の、押下回数・反応時間の分布・日ごとのスティックのドリフト・パケットロス率を出す
+//
+// 例: analytics ~/sessions --threads 8
+//     analytics ~/sessions --jsonl > report.jsonl
+//
+// ファイルは work stealing のスレッドプールで並列にメモリマップ・展開する
+// 結果はスレッドごとに集計し、最後に1回だけ合わせる (集計中に共有のロックは取らない)
+//
+// 記録には刺激の時刻がないので、反応時間は「あるボタンを押してから別のボタンを押すまで」の間隔で代用する
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <ctime>
+#include <cstdio>
+#include <cstdint>
+#include "../Visualizer/SessionArchive.h"
+#include "../Visualizer/SwitchPro.h"
+
+struct Options
+{
+	std::string directory;
+	int threads = 0;
+	bool jsonl = false;
+	int deadzone = 100;     // この範囲内なら静止中とみなしてドリフトを測る (補正後の値)
+};
+
+static void usage() {
+	std::cerr <<
+		"usage: analytics DIRECTORY [options]\n"
+		"  --threads N          worker threads (all cores)\n"
+		"  --deadzone N         |axis| below this counts as resting for drift (100)\n"
+		"  --jsonl              one JSON object per session and one for the total\n";
+}
+
+static bool parse_options(int argc, char** argv, Options& opt) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--jsonl") {
+			opt.jsonl = true;
+			continue;
+		}
+		if (arg.rfind("--", 0) != 0) {
+			opt.directory = arg;
+			continue;
+		}
+		if (i + 1 >= argc) return false;
+		std::string val = argv[++i];
+
+		if (arg == "--threads") opt.threads = std::stoi(val);
+		else if (arg == "--deadzone") opt.deadzone = std::stoi(val);
+		else return false;
+	}
+	return !opt.directory.empty();
+}
+
+// ====== 集計 ======
+
+// 1ms 刻みのヒストグラム (範囲外は最後のバケット)。足し合わせで合成できる
+struct Histogram
+{
+	static constexpr size_t BUCKETS = 2001;
+	std::array<uint32_t, BUCKETS> counts{};
+	uint64_t total = 0;
+
+	void Add(int64_t us) {
+		size_t ms = (size_t)std::max<int64_t>(0, us / 1000);
+		++counts[std::min(ms, BUCKETS - 1)];
+		++total;
+	}
+
+	void Merge(const Histogram& other) {
+		for (size_t i = 0; i < BUCKETS; ++i) counts[i] += other.counts[i];
+		total += other.total;
+	}
+
+	bool Empty() const { return total == 0; }
+
+	// ms (空なら 0。出力では json_percentile / text_percentile を使う)
+	size_t Percentile(double p) const {
+		if (total == 0) return 0;
+		uint64_t target = (uint64_t)(p * (total - 1)) + 1;
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BUCKETS; ++i) {
+			seen += counts[i];
+			if (seen >= target) return i;
+		}
+		return BUCKETS - 1;
+	}
+};
+
+struct SessionStats
+{
+	std::string path;
+	bool ok = false;
+	int64_t startEpochUs = 0;
+	double seconds = 0;
+	uint64_t samples = 0;
+	uint64_t lost = 0;                  // tick の飛びから推定した欠落レポート数
+	std::array<uint64_t, 24> presses{};
+	Histogram reaction;                 // 別ボタンへの切り替え間隔
+	Histogram hold;                     // 押している時間
+	double driftSum[4] = {};            // 静止中の生値 - 2048 の合計 (LX, LY, RX, RY)
+	uint64_t driftCount[2] = {};        // 静止中のサンプル数 (L, R)
+
+	double LossRate() const { return samples + lost ? (double)lost / (samples + lost) : 0; }
+	double Drift(int axis) const {
+		uint64_t n = driftCount[axis / 2];
+		return n ? driftSum[axis] / n : 0;
+	}
+};
+
+// スレッドごとの全体集計。最後に Merge で合わせる
+struct Aggregate
+{
+	uint64_t sessions = 0;
+	uint64_t failed = 0;
+	double seconds = 0;
+	uint64_t samples = 0;
+	uint64_t lost = 0;
+	std::array<uint64_t, 24> presses{};
+	Histogram reaction;
+	Histogram hold;
+
+	void Add(const SessionStats& s) {
+		if (!s.ok) {
+			++failed;
+			return;
+		}
+		++sessions;
+		seconds += s.seconds;
+		samples += s.samples;
+		lost += s.lost;
+		for (int b = 0; b < 24; ++b) presses[b] += s.presses[b];
+		reaction.Merge(s.reaction);
+		hold.Merge(s.hold);
+	}
+
+	void Merge(const Aggregate& other) {
+		sessions += other.sessions;
+		failed += other.failed;
+		seconds += other.seconds;
+		samples += other.samples;
+		lost += other.lost;
+		for (int b = 0; b < 24; ++b) presses[b] += other.presses[b];
+		reaction.Merge(other.reaction);
+		hold.Merge(other.hold);
+	}
+};
+
+static int lowest_bit(uint32_t m) {
+	int bit = 0;
+	while (!(m & 1)) {
+		m >>= 1;
+		++bit;
+	}
+	return bit;
+}
+
+// 1セッションを先頭から順に展開して集計する
+static void analyze(const Options& opt, SessionStats& s) {
+	SessionArchive::Reader reader;
+	if (!reader.Open(s.path)) return;
+	s.ok = true;
+	s.startEpochUs = reader.StartEpochUs();
+	s.seconds = (reader.EndUs() - reader.StartUs()) / 1e6;
+
+	// レポート周期 (tick) は、先頭ブロックの差分の最頻値とする
+	std::vector<SessionArchive::Sample> block;
+	uint64_t period = 0;
+	if (reader.BlockCount() > 0 && reader.ReadBlock(0, block) && block.size() > 1) {
+		std::map<uint64_t, size_t> freq;
+		for (size_t i = 1; i < block.size(); ++i) {
+			if (block[i].ticks > block[i - 1].ticks) ++freq[block[i].ticks - block[i - 1].ticks];
+		}
+		size_t best = 0;
+		for (const auto& [delta, n] : freq) {
+			if (n > best) {
+				best = n;
+				period = delta;
+			}
+		}
+	}
+
+	bool first = true;
+	SessionArchive::Sample prev = {};
+	std::array<int64_t, 24> pressedAt{};
+	int64_t lastPressUs = -1;
+	int lastPressBit = -1;
+
+	for (size_t b = 0; b < reader.BlockCount(); ++b) {
+		if (!reader.ReadBlock(b, block)) {
+			s.ok = false;
+			return;
+		}
+		for (const auto& x : block) {
+			++s.samples;
+
+			if (!first && period > 0 && x.ticks > prev.ticks) {
+				uint64_t gap = (x.ticks - prev.ticks + period / 2) / period;
+				if (gap > 1) s.lost += gap - 1;
+			}
+
+			uint32_t before = first ? 0 : prev.buttons;
+			uint32_t rising = x.buttons & ~before;
+			uint32_t falling = before & ~x.buttons;
+			for (uint32_t m = rising; m; m &= m - 1) {
+				int bit = lowest_bit(m);
+				++s.presses[bit];
+				pressedAt[bit] = x.timeUs;
+				if (lastPressBit >= 0 && lastPressBit != bit) s.reaction.Add(x.timeUs - lastPressUs);
+				lastPressUs = x.timeUs;
+				lastPressBit = bit;
+			}
+			for (uint32_t m = falling; m; m &= m - 1) {
+				int bit = lowest_bit(m);
+				s.hold.Add(x.timeUs - pressedAt[bit]);
+			}
+
+			// ニュートラル付近で止まっているときの生値のずれ
+			for (int st = 0; st < 2; ++st) {
+				if (std::abs(x.axis[st * 2]) < opt.deadzone && std::abs(x.axis[st * 2 + 1]) < opt.deadzone) {
+					s.driftSum[st * 2] += x.raw[st * 2] - 2048.0;
+					s.driftSum[st * 2 + 1] += x.raw[st * 2 + 1] - 2048.0;
+					++s.driftCount[st];
+				}
+			}
+
+			prev = x;
+			first = false;
+		}
+	}
+}
+
+// ====== スレッドプール ======
+
+// スレッドごとに両端キューを持ち、自分のキューは後ろから、他のキューは前から盗む
+// タスクは最初にすべて積むので、どのキューも空になったら終わり
+class WorkStealingPool
+{
+public:
+	WorkStealingPool(int threads) : queues(threads) {}
+
+	// 大きいタスクから順に配ると、最後に長いタスクだけが残りにくい
+	void Push(size_t task) {
+		Queue& q = queues[pushed++ % queues.size()];
+		q.tasks.push_back(task);
+	}
+
+	void Run(const std::function<void(int worker, size_t task)>& fn) {
+		std::vector<std::thread> pool;
+		for (int w = 1; w < (int)queues.size(); ++w) pool.emplace_back([&, w] { Work(w, fn); });
+		Work(0, fn);
+		for (auto& t : pool) t.join();
+	}
+
+	uint64_t Steals() const { return steals; }
+
+private:
+	struct Queue
+	{
+		std::mutex mtx;
+		std::deque<size_t> tasks;
+	};
+
+	void Work(int w, const std::function<void(int, size_t)>& fn) {
+		size_t task;
+		while (Pop(w, task) || Steal(w, task)) fn(w, task);
+	}
+
+	bool Pop(int w, size_t& task) {
+		Queue& q = queues[w];
+		std::lock_guard<std::mutex> lock(q.mtx);
+		if (q.tasks.empty()) return false;
+		task = q.tasks.back();
+		q.tasks.pop_back();
+		return true;
+	}
+
+	bool Steal(int w, size_t& task) {
+		for (size_t k = 1; k < queues.size(); ++k) {
+			Queue& q = queues[(w + k) % queues.size()];
+			std::lock_guard<std::mutex> lock(q.mtx);
+			if (q.tasks.empty()) continue;
+			task = q.tasks.front();
+			q.tasks.pop_front();
+			++steals;
+			return true;
+		}
+		return false;
+	}
+
+	std::vector<Queue> queues;
+	size_t pushed = 0;
+	std::atomic<uint64_t> steals{ 0 };
+};
+
+// ====== 出力 ======
+
+static std::string day_of(int64_t epochUs) {
+	std::time_t t = (std::time_t)(epochUs / 1000000);
+	std::tm tm;
+#ifdef _WIN32
+	localtime_s(&tm, &t);
+#else
+	localtime_r(&t, &tm);
+#endif
+	char buf[16];
+	std::strftime(buf, sizeof(buf), "%Y-%m-%d", &tm);
+	return buf;
+}
+
+// JSON の文字列リテラルにする (", \, 制御文字をエスケープ)
+static std::string json_string(const std::string& s) {
+	std::string out = "\"";
+	for (unsigned char c : s) {
+		switch (c) {
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if (c < 0x20) {
+				char buf[8];
+				std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+				out += buf;
+			}
+			else {
+				out += (char)c;
+			}
+		}
+	}
+	return out + "\"";
+}
+
+// 空のヒストグラムにはパーセンタイルがないので、JSON は null、テキストは "-" にする
+static std::string json_percentile(const Histogram& h, double p) {
+	return h.Empty() ? "null" : std::to_string(h.Percentile(p));
+}
+
+static std::string text_percentile(const Histogram& h, double p, const char* unit) {
+	return h.Empty() ? "-" : std::to_string(h.Percentile(p)) + unit;
+}
+
+static void print_presses_json(const std::array<uint64_t, 24>& presses) {
+	std::printf("\"presses\":{");
+	bool first = true;
+	for (int b = 0; b < 24; ++b) {
+		if (!SwitchPro::BUTTON_NAMES[b][0]) continue;
+		std::printf("%s\"%s\":%llu", first ? "" : ",", SwitchPro::BUTTON_NAMES[b], (unsigned long long)presses[b]);
+		first = false;
+	}
+	std::printf("}");
+}
+
+static void print_session_json(const SessionStats& s) {
+	std::printf("{\"session\":%s,\"ok\":%s", json_string(s.path).c_str(), s.ok ? "true" : "false");
+	if (s.ok) {
+		std::printf(",\"day\":%s,\"seconds\":%.1f,\"samples\":%llu,\"loss_rate\":%.6f,",
+			json_string(day_of(s.startEpochUs)).c_str(), s.seconds, (unsigned long long)s.samples, s.LossRate());
+		print_presses_json(s.presses);
+		std::printf(",\"reaction_ms\":{\"p10\":%s,\"p50\":%s,\"p90\":%s},\"hold_ms\":{\"p50\":%s}",
+			json_percentile(s.reaction, 0.1).c_str(), json_percentile(s.reaction, 0.5).c_str(),
+			json_percentile(s.reaction, 0.9).c_str(), json_percentile(s.hold, 0.5).c_str());
+		std::printf(",\"drift\":[%.2f,%.2f,%.2f,%.2f]", s.Drift(0), s.Drift(1), s.Drift(2), s.Drift(3));
+	}
+	std::printf("}\n");
+}
+
+int main(int argc, char** argv) {
+	Options opt;
+	if (!parse_options(argc, argv, opt)) {
+		usage();
+		return 1;
+	}
+	if (opt.threads <= 0) opt.threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// 対象ファイルを集めて、大きい順に並べる
+	std::vector<std::pair<uintmax_t, std::string>> files;
+	std::error_code ec;
+	for (auto it = std::filesystem::recursive_directory_iterator(opt.directory, ec);
+		!ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+		if (it->is_regular_file() && it->path().extension() == ".ivs") {
+			files.emplace_back(it->file_size(), it->path().string());
+		}
+	}
+	if (ec) {
+		std::cerr << "Error: cannot scan " << opt.directory << ": " << ec.message() << std::endl;
+		return 1;
+	}
+	std::sort(files.begin(), files.end(), std::greater<>());
+
+	// 結果の置き場所は先に確保しておき、各タスクは自分の要素にだけ書く
+	std::vector<SessionStats> sessions(files.size());
+	std::vector<Aggregate> partial(opt.threads);
+	WorkStealingPool pool(opt.threads);
+	for (size_t i = 0; i < files.size(); ++i) {
+		sessions[i].path = files[i].second;
+		pool.Push(i);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	pool.Run([&](int worker, size_t task) {
+		analyze(opt, sessions[task]);
+		partial[worker].Add(sessions[task]);
+	});
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	Aggregate total;
+	for (const auto& p : partial) total.Merge(p);
+
+	// 日ごとのドリフト (静止中のサンプル数で重み付け)
+	struct Day
+	{
+		double sum[4] = {};
+		uint64_t count[2] = {};
+		uint64_t sessions = 0;
+	};
+	std::map<std::string, Day> days;
+	for (const auto& s : sessions) {
+		if (!s.ok) continue;
+		Day& d = days[day_of(s.startEpochUs)];
+		for (int a = 0; a < 4; ++a) d.sum[a] += s.driftSum[a];
+		d.count[0] += s.driftCount[0];
+		d.count[1] += s.driftCount[1];
+		++d.sessions;
+	}
+	auto dayDrift = [](const Day& d, int axis) {
+		uint64_t n = d.count[axis / 2];
+		return n ? d.sum[axis] / n : 0.0;
+	};
+
+	double lossRate = total.samples + total.lost ? (double)total.lost / (total.samples + total.lost) : 0;
+
+	if (opt.jsonl) {
+		std::sort(sessions.begin(), sessions.end(), [](const SessionStats& a, const SessionStats& b) { return a.path < b.path; });
+		for (const auto& s : sessions) print_session_json(s);
+		std::printf("{\"total\":true,\"sessions\":%llu,\"failed\":%llu,\"hours\":%.2f,\"samples\":%llu,\"loss_rate\":%.6f,",
+			(unsigned long long)total.sessions, (unsigned long long)total.failed, total.seconds / 3600,
+			(unsigned long long)total.samples, lossRate);
+		print_presses_json(total.presses);
+		std::printf(",\"reaction_ms\":{\"p10\":%s,\"p50\":%s,\"p90\":%s},\"hold_ms\":{\"p50\":%s},\"drift_by_day\":{",
+			json_percentile(total.reaction, 0.1).c_str(), json_percentile(total.reaction, 0.5).c_str(),
+			json_percentile(total.reaction, 0.9).c_str(), json_percentile(total.hold, 0.5).c_str());
+		bool first = true;
+		for (const auto& [day, d] : days) {
+			std::printf("%s%s:[%.2f,%.2f,%.2f,%.2f]", first ? "" : ",", json_string(day).c_str(),
+				dayDrift(d, 0), dayDrift(d, 1), dayDrift(d, 2), dayDrift(d, 3));
+			first = false;
+		}
+		std::printf("},\"elapsed_s\":%.3f,\"threads\":%d}\n", elapsed, opt.threads);
+		return 0;
+	}
+
+	std::sort(sessions.begin(), sessions.end(), [](const SessionStats& a, const SessionStats& b) { return a.path < b.path; });
+	std::printf("%-40s %-10s %9s %9s %7s %8s %8s\n", "session", "day", "minutes", "presses", "loss%", "react50", "drift L");
+	for (const auto& s : sessions) {
+		std::string name = std::filesystem::path(s.path).filename().string();
+		if (!s.ok) {
+			std::printf("%-40s (unreadable)\n", name.c_str());
+			continue;
+		}
+		uint64_t presses = 0;
+		for (auto n : s.presses) presses += n;
+		std::printf("%-40s %-10s %9.1f %9llu %7.3f %8s %+4.0f,%+4.0f\n", name.c_str(), day_of(s.startEpochUs).c_str(),
+			s.seconds / 60, (unsigned long long)presses, s.LossRate() * 100, text_percentile(s.reaction, 0.5, "ms").c_str(),
+			s.Drift(0), s.Drift(1));
+	}
+
+	std::printf("\n%llu sessions (%llu unreadable), %.1f hours, %llu samples, packet loss %.3f%%\n",
+		(unsigned long long)total.sessions, (unsigned long long)total.failed, total.seconds / 3600,
+		(unsigned long long)total.samples, lossRate * 100);
+
+	std::printf("\npresses:");
+	for (int b = 0; b < 24; ++b) {
+		if (SwitchPro::BUTTON_NAMES[b][0] && total.presses[b]) std::printf(" %s %llu", SwitchPro::BUTTON_NAMES[b], (unsigned long long)total.presses[b]);
+	}
+	std::printf("\nreaction (press to a different button): p10 %s, p50 %s, p90 %s\n",
+		text_percentile(total.reaction, 0.1, " ms").c_str(), text_percentile(total.reaction, 0.5, " ms").c_str(),
+		text_percentile(total.reaction, 0.9, " ms").c_str());
+	std::printf("hold: p10 %s, p50 %s, p90 %s\n",
+		text_percentile(total.hold, 0.1, " ms").c_str(), text_percentile(total.hold, 0.5, " ms").c_str(),
+		text_percentile(total.hold, 0.9, " ms").c_str());
+
+	std::printf("\nstick drift at rest (raw - 2048):\n%-10s %8s %7s %7s %7s %7s\n", "day", "sessions", "LX", "LY", "RX", "RY");
+	for (const auto& [day, d] : days) {
+		std::printf("%-10s %8llu %+7.1f %+7.1f %+7.1f %+7.1f\n", day.c_str(), (unsigned long long)d.sessions,
+			dayDrift(d, 0), dayDrift(d, 1), dayDrift(d, 2), dayDrift(d, 3));
+	}
+
+	std::fprintf(stderr, "%zu files in %.3f s on %d threads (%llu steals)\n",
+		files.size(), elapsed, opt.threads, (unsigned long long)pool.Steals());
+	return 0;
+}
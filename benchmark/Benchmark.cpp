@@ -0,0 +1,339 @@
+﻿// 受信 → デコード → 公開 の各段を個別に計測するベンチマーク
+// 結果は1行1件の JSON で標準出力に出す (バージョン間の比較用)
+//
+// 例: benchmark --reports 200000 --input capture.bin > result.jsonl
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <new>
+#include <memory>
+#include <asio.hpp>
+#include "../Visualizer/SwitchPro.h"
+#include "../Visualizer/FrameParser.h"
+#include "../Visualizer/SerialAnalizer.h"
+
+// ====== 確保回数の計測 ======
+
+static std::atomic<uint64_t> g_allocs{ 0 };
+
+void* operator new(std::size_t size) {
+	++g_allocs;
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// ====== 入力データ ======
+
+// メモリ上のバイト列を asio の SyncReadStream として見せる
+class MemoryStream
+{
+public:
+	MemoryStream(const std::vector<uint8_t>& data) : data(data) {}
+
+	template <typename MutableBufferSequence>
+	size_t read_some(const MutableBufferSequence& buffers, asio::error_code& ec) {
+		if (pos >= data.size()) {
+			ec = asio::error::eof;
+			return 0;
+		}
+		ec = {};
+		size_t n = asio::buffer_copy(buffers, asio::buffer(data.data() + pos, data.size() - pos));
+		pos += n;
+		return n;
+	}
+
+	template <typename MutableBufferSequence>
+	size_t read_some(const MutableBufferSequence& buffers) {
+		asio::error_code ec;
+		size_t n = read_some(buffers, ec);
+		if (ec) throw asio::system_error(ec);
+		return n;
+	}
+
+	bool eof() const { return pos >= data.size(); }
+
+private:
+	const std::vector<uint8_t>& data;
+	size_t pos = 0;
+};
+
+// シミュレータと同じ形式のフレーム列を作る
+static std::vector<uint8_t> synthetic_stream(size_t reports, double corrupt) {
+	std::vector<uint8_t> out;
+	out.reserve(reports * 17);
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int> stick(300, 3800);
+	std::uniform_int_distribution<int> byte(0, 255);
+	std::uniform_real_distribution<double> uni(0, 1);
+
+	for (size_t i = 0; i < reports; ++i) {
+		uint16_t s[4] = { (uint16_t)stick(rng), (uint16_t)stick(rng), (uint16_t)stick(rng), (uint16_t)stick(rng) };
+		uint8_t frame[16] = {
+			0xAA, 13, 0x30, (uint8_t)i, 0x8E,
+			(uint8_t)(byte(rng) & 0xCF), (uint8_t)(byte(rng) & 0x3F), (uint8_t)(byte(rng) & 0xCF),
+			(uint8_t)(s[0] & 0xFF), (uint8_t)(((s[0] >> 8) & 0x0F) | ((s[1] & 0x0F) << 4)), (uint8_t)(s[1] >> 4),
+			(uint8_t)(s[2] & 0xFF), (uint8_t)(((s[2] >> 8) & 0x0F) | ((s[3] & 0x0F) << 4)), (uint8_t)(s[3] >> 4),
+			0x00, 0xBB,
+		};
+		if (corrupt > 0 && uni(rng) < corrupt) frame[15] ^= 0x5A;
+		out.insert(out.end(), frame, frame + 16);
+	}
+	return out;
+}
+
+// ストリームからレポート本体だけを取り出す (デコード・公開の入力)
+static std::vector<std::vector<uint8_t>> extract_reports(const std::vector<uint8_t>& stream) {
+	std::vector<std::vector<uint8_t>> reports;
+	SwitchPro::FrameParser parser;
+	parser.Feed(stream.data(), stream.size(), [&](const uint8_t* report, uint8_t length) {
+		if (length >= 12) reports.emplace_back(report, report + length);
+	});
+	return reports;
+}
+
+// ====== 計測 ======
+
+struct Result
+{
+	std::string name;
+	std::string stream;
+	int threads = 1;
+	uint64_t reports = 0;
+	double seconds = 0;
+	uint64_t allocs = 0;
+	uint64_t reads = 0; // publish: 計測中に読み出し側が GetSample した回数
+};
+
+static void print(const Result& r) {
+	double ns = r.reports ? r.seconds * 1e9 / r.reports : 0;
+	double rps = r.seconds > 0 ? r.reports / r.seconds : 0;
+	double apr = r.reports ? (double)r.allocs / r.reports : 0;
+	double reads = r.seconds > 0 ? r.reads / r.seconds : 0;
+	std::printf("{\"benchmark\":\"%s\",\"stream\":\"%s\",\"threads\":%d,\"reports\":%llu,"
+		"\"ns_per_report\":%.2f,\"reports_per_sec\":%.0f,\"allocs_per_report\":%.3f,\"reads_per_sec\":%.0f}\n",
+		r.name.c_str(), r.stream.c_str(), r.threads, (unsigned long long)r.reports, ns, rps, apr, reads);
+}
+
+// body は処理したレポート数を返す。最速の回を採用する
+static Result run(const std::string& name, const std::string& stream, int repeat, std::function<uint64_t()> body) {
+	Result best;
+	best.name = name;
+	best.stream = stream;
+	for (int i = 0; i < repeat; ++i) {
+		uint64_t allocs = g_allocs;
+		auto start = std::chrono::steady_clock::now();
+		uint64_t reports = body();
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (i == 0 || sec < best.seconds) {
+			best.seconds = sec;
+			best.reports = reports;
+			best.allocs = g_allocs - allocs;
+		}
+	}
+	return best;
+}
+
+// 計測対象の SerialAnalizer を回数分先に作っておく (生成のコストと確保を計測に含めない)
+static std::vector<std::unique_ptr<SerialAnalizer>> make_analyzers(int count) {
+	std::vector<std::unique_ptr<SerialAnalizer>> analyzers;
+	for (int i = 0; i < count; ++i) analyzers.emplace_back(SerialAnalizer::CreateDetached());
+	return analyzers;
+}
+
+// ReadLoop と同じく、chunk バイトずつ SerialAnalizer::Feed に渡す
+static uint64_t feed(SerialAnalizer& serial, const std::vector<uint8_t>& data, size_t chunk) {
+	uint64_t first = serial.ReadLatency().Count();
+	for (size_t pos = 0; pos < data.size(); pos += chunk) {
+		serial.Feed(data.data() + pos, std::min(chunk, data.size() - pos), std::chrono::steady_clock::now());
+	}
+	return serial.ReadLatency().Count() - first;
+}
+
+static volatile uint64_t g_sink;
+
+// 旧 ReadLoop と同じ1バイトずつの読み込み (フレームごとに vector を確保)
+static uint64_t frame_legacy(const std::vector<uint8_t>& data) {
+	const uint8_t startByte = 0xAA;
+	const uint8_t endByte = 0xBB;
+	MemoryStream port(data);
+	uint64_t frames = 0;
+
+	try {
+		while (!port.eof()) {
+			uint8_t current_byte;
+			asio::read(port, asio::buffer(&current_byte, 1));
+			if (current_byte != startByte) continue;
+
+			uint8_t length;
+			asio::read(port, asio::buffer(&length, 1));
+
+			std::vector<uint8_t> in_report(length, 0);
+			asio::read(port, asio::buffer(in_report));
+
+			asio::read(port, asio::buffer(&current_byte, 1));
+			if (current_byte != endByte) continue;
+
+			g_sink = in_report[1];
+			++frames;
+		}
+	}
+	catch (std::exception&) {
+		// 末尾の途中フレーム
+	}
+	return frames;
+}
+
+// まとめ読み + FrameParser (切り出しのみ)
+static uint64_t frame_parser(const std::vector<uint8_t>& data, size_t chunk) {
+	SwitchPro::FrameParser parser;
+	MemoryStream port(data);
+	uint8_t buf[256];
+	uint64_t frames = 0;
+
+	asio::error_code ec;
+	while (!port.eof()) {
+		size_t n = port.read_some(asio::buffer(buf, std::min(chunk, sizeof(buf))), ec);
+		parser.Feed(buf, n, [&](const uint8_t* report, uint8_t) {
+			g_sink = report[1];
+			++frames;
+		});
+	}
+	return frames;
+}
+
+static uint64_t decode(const std::vector<std::vector<uint8_t>>& reports) {
+	uint64_t sum = 0;
+	for (const auto& r : reports) {
+		SwitchPro::InReport rep;
+		SwitchPro::GamePad gp;
+		uint16_t raw[4];
+		SwitchPro::Parse(r.data(), rep);
+		SwitchPro::DecodeButtons(rep, gp);
+		SwitchPro::UnpackSticks(rep, raw);
+		sum += gp.A + gp.ZR + raw[0] + raw[3];
+	}
+	g_sink = sum;
+	return reports.size();
+}
+
+// 読み込みスレッドの SerialAnalizer::Feed と、描画側の GetSample が同時に走るときの受け渡し
+// 読み出し側のスレッドはすべて動き出してから計測を始める
+static Result publish(const std::vector<uint8_t>& data, int readers, int repeat) {
+	Result best;
+	best.name = "publish";
+	best.stream = "synthetic";
+	best.threads = readers + 1;
+
+	for (int i = 0; i < repeat; ++i) {
+		std::unique_ptr<SerialAnalizer> serial(SerialAnalizer::CreateDetached());
+		std::atomic<bool> done{ false };
+		std::atomic<int> ready{ 0 };
+		std::vector<std::atomic<uint64_t>> counts(readers);
+		std::vector<std::thread> threads;
+		for (int r = 0; r < readers; ++r) {
+			threads.emplace_back([&, r] {
+				uint64_t n = 0, sum = 0;
+				++ready;
+				while (!done.load(std::memory_order_relaxed)) {
+					sum += serial->GetSample().seq;
+					counts[r].store(++n, std::memory_order_relaxed);
+				}
+				g_sink = sum;
+			});
+		}
+		while (ready < readers) std::this_thread::yield();
+
+		uint64_t readsBefore = 0;
+		for (auto& c : counts) readsBefore += c.load(std::memory_order_relaxed);
+		uint64_t allocs = g_allocs;
+		auto start = std::chrono::steady_clock::now();
+		uint64_t reports = feed(*serial, data, 256);
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		uint64_t allocated = g_allocs - allocs;
+		uint64_t reads = 0;
+		for (auto& c : counts) reads += c.load(std::memory_order_relaxed);
+
+		done = true;
+		for (auto& t : threads) t.join();
+		if (i == 0 || sec < best.seconds) {
+			best.seconds = sec;
+			best.reports = reports;
+			best.allocs = allocated;
+			best.reads = reads - readsBefore;
+		}
+	}
+	return best;
+}
+
+static void usage() {
+	std::cerr <<
+		"usage: benchmark [options]\n"
+		"  --reports N      synthetic reports per run (200000)\n"
+		"  --corrupt P      probability of a corrupted frame in the synthetic stream (0.001)\n"
+		"  --input FILE     also run on a recorded raw byte stream\n"
+		"  --repeat N       runs per benchmark, fastest is reported (5)\n";
+}
+
+int main(int argc, char** argv) {
+	size_t reports = 200000;
+	double corrupt = 0.001;
+	int repeat = 5;
+	std::string input;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		if (arg == "--reports") reports = std::stoul(argv[i + 1]);
+		else if (arg == "--corrupt") corrupt = std::stod(argv[i + 1]);
+		else if (arg == "--input") input = argv[i + 1];
+		else if (arg == "--repeat") repeat = std::stoi(argv[i + 1]);
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (argc % 2 == 0) {
+		usage();
+		return 1;
+	}
+
+	std::vector<std::pair<std::string, std::vector<uint8_t>>> streams;
+	streams.emplace_back("synthetic", synthetic_stream(reports, corrupt));
+	if (!input.empty()) {
+		std::ifstream ifs(input, std::ios::binary);
+		if (!ifs) {
+			std::cerr << "Error: cannot open " << input << std::endl;
+			return 1;
+		}
+		streams.emplace_back(input, std::vector<uint8_t>((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>()));
+	}
+
+	for (const auto& [name, data] : streams) {
+		print(run("frame_legacy", name, repeat, [&] { return frame_legacy(data); }));
+		print(run("frame_parser_chunk16", name, repeat, [&] { return frame_parser(data, 16); }));
+		print(run("frame_parser_chunk256", name, repeat, [&] { return frame_parser(data, 256); }));
+
+		auto extracted = extract_reports(data);
+		print(run("decode", name, repeat, [&] { return decode(extracted); }));
+
+		// フレーム切り出し・デコード・DeviceClock・フィルタ・公開 (SerialAnalizer の読み込み処理そのもの)
+		auto analyzers = make_analyzers(repeat);
+		size_t next = 0;
+		print(run("analyzer_feed", name, repeat, [&] { return feed(*analyzers[next++], data, 256); }));
+	}
+
+	for (int readers : { 0, 1, 3 }) {
+		print(publish(streams[0].second, readers, repeat));
+	}
+
+	return 0;
+}
@@ -0,0 +1,454 @@
+﻿// 2つの記録セッションを DTW (動的時間伸縮) で揃え、お手本と比べてボタンの押し遅れ・早押し・押し忘れを示す
+// 練習・RTA のコーチング用
+//
+// 例: compare reference.ivs attempt.ivs --band 3 --threads 8
+//
+// 両セッションを一定周期 (--rate) に揃えてから、スティック4軸 + ボタンマスクの距離で
+// Sakoe-Chiba 帯 (対角線 ± --band 秒) の中だけを計算する
+//   - 1行ぶんのコスト計算と上・左上からの最小値は SSE2 で4列ずつ処理する (左からの依存だけ逐次)
+//   - 行方向・列方向にタイルに分け、反対角線上のタイルを並列に計算する
+// 押下のずれは、経路をそのまま使うとボタンごと揃えられてしまうので、前後 --smooth 秒で平均した経路を基準に測る
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define COMPARE_SSE2
+#endif
+#include "../Visualizer/SessionArchive.h"
+#include "../Visualizer/SwitchPro.h"
+
+struct Options
+{
+	std::string reference;
+	std::string attempt;
+	double rate = 125;          // 揃える周期 (Hz)
+	double band = 3;            // 帯の半幅 (秒)
+	double buttonWeight = 0.5;  // 異なるボタン1つあたりの距離 (スティックは ±1 に正規化)
+	double tolerance = 0.25;    // 対応する押下を探す範囲 (秒)
+	double okMs = 20;           // これ以内のずれは一致とみなす
+	double smooth = 0.5;        // 基準にする経路の平均範囲 (秒)
+	int threads = 0;
+	bool all = false;
+};
+
+static void usage() {
+	std::cerr <<
+		"usage: compare REFERENCE.ivs ATTEMPT.ivs [options]\n"
+		"  --rate HZ            resampling rate (125)\n"
+		"  --band SEC           Sakoe-Chiba band half width (3)\n"
+		"  --button-weight W    distance per differing button (0.5)\n"
+		"  --tolerance SEC      search window for the matching press (0.25)\n"
+		"  --ok-ms MS           offsets within this are on time (20)\n"
+		"  --smooth SEC         warp smoothing for timing offsets (0.5)\n"
+		"  --threads N          worker threads (all cores)\n"
+		"  --all                also list presses that were on time\n";
+}
+
+static bool parse_options(int argc, char** argv, Options& opt) {
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--all") {
+			opt.all = true;
+			continue;
+		}
+		if (arg.rfind("--", 0) != 0) {
+			files.push_back(arg);
+			continue;
+		}
+		if (i + 1 >= argc) return false;
+		std::string val = argv[++i];
+
+		if (arg == "--rate") opt.rate = std::stod(val);
+		else if (arg == "--band") opt.band = std::stod(val);
+		else if (arg == "--button-weight") opt.buttonWeight = std::stod(val);
+		else if (arg == "--tolerance") opt.tolerance = std::stod(val);
+		else if (arg == "--ok-ms") opt.okMs = std::stod(val);
+		else if (arg == "--smooth") opt.smooth = std::stod(val);
+		else if (arg == "--threads") opt.threads = std::stoi(val);
+		else return false;
+	}
+	if (files.size() != 2) return false;
+	opt.reference = files[0];
+	opt.attempt = files[1];
+	return opt.rate > 0 && opt.band > 0;
+}
+
+// ====== 入力 ======
+
+// 一定周期に揃えた系列 (SoA)。ボタンは周期内に押されたものをすべて含める
+struct Series
+{
+	std::vector<float> axis[4];
+	std::vector<uint32_t> buttons;
+
+	size_t Size() const { return buttons.size(); }
+};
+
+static bool load_series(const std::string& path, double rate, Series& out) {
+	SessionArchive::Reader reader;
+	if (!reader.Open(path) || reader.SampleCount() == 0) {
+		std::cerr << "Error: cannot read " << path << std::endl;
+		return false;
+	}
+
+	const double stepUs = 1e6 / rate;
+	const int64_t start = reader.StartUs();
+	const size_t frames = (size_t)(std::max<int64_t>(reader.EndUs() - start, 0) / stepUs) + 1;
+	for (auto& a : out.axis) a.assign(frames, 0.0f);
+	out.buttons.assign(frames, 0);
+
+	// 各フレームは直前のサンプルの値を保持する
+	std::vector<SessionArchive::Sample> block;
+	size_t k = 0;
+	SessionArchive::Sample last = {};
+	for (size_t b = 0; b < reader.BlockCount(); ++b) {
+		if (!reader.ReadBlock(b, block)) break;
+		for (const auto& s : block) {
+			// 負の値を size_t にすると未定義なので先に 0 に丸める
+			size_t f = std::min((size_t)(std::max<int64_t>(s.timeUs - start, 0) / stepUs), frames - 1);
+			for (; k < f; ++k) {
+				for (int a = 0; a < 4; ++a) out.axis[a][k] = last.axis[a] / 2048.0f;
+				out.buttons[k] |= last.buttons;
+			}
+			out.buttons[f] |= s.buttons;
+			last = s;
+		}
+	}
+	for (; k < frames; ++k) {
+		for (int a = 0; a < 4; ++a) out.axis[a][k] = last.axis[a] / 2048.0f;
+		out.buttons[k] |= last.buttons;
+	}
+	return true;
+}
+
+// ====== DTW ======
+
+// 行 i の帯は列 [Lo(i), Lo(i) + band) 。長い方の系列を行にするので、Lo は1行で高々1しか進まない
+// 累積コストは帯の形のまま (両端に INF の番兵を1つずつ置いて) 保持する
+class BandedDtw
+{
+public:
+	static constexpr int64_t TILE_ROWS = 128;
+	static constexpr int64_t TILE_COLS = 128;
+
+	BandedDtw(const Series& rows, const Series& cols, int64_t radius, float buttonWeight)
+		: a(rows), b(cols), n((int64_t)rows.Size()), m((int64_t)cols.Size()), radius(radius),
+		band(2 * radius + 1), width(band + 2), buttonWeight(buttonWeight) {
+		d.assign((size_t)(n * width), INF);
+	}
+
+	void Run(int threads);
+	float Cost() const { return At(n - 1, m - 1); }
+	// (0,0) から (n-1,m-1) までの経路
+	std::vector<std::pair<int64_t, int64_t>> Path() const;
+
+private:
+	static constexpr float INF = std::numeric_limits<float>::infinity();
+
+	int64_t Center(int64_t i) const { return n > 1 ? i * (m - 1) / (n - 1) : 0; }
+	int64_t Lo(int64_t i) const { return Center(i) - radius; }
+	float* Row(int64_t i) { return d.data() + i * width; }
+	float At(int64_t i, int64_t j) const {
+		int64_t k = j - Lo(i);
+		return (i < 0 || j < 0 || k < 0 || k >= band) ? INF : d[(size_t)(i * width + k + 1)];
+	}
+
+	bool TileActive(int64_t bi, int64_t bj) const;
+	void Tile(int64_t bi, int64_t bj, float* scratch);
+	void ComputeRow(int64_t i, int64_t j0, int64_t j1, float* scratch);
+
+	const Series& a;
+	const Series& b;
+	int64_t n, m;
+	int64_t radius, band, width;
+	float buttonWeight;
+	std::vector<float> d;
+};
+
+bool BandedDtw::TileActive(int64_t bi, int64_t bj) const {
+	int64_t i0 = bi * TILE_ROWS;
+	int64_t i1 = std::min(n, i0 + TILE_ROWS) - 1;
+	int64_t j0 = bj * TILE_COLS;
+	int64_t j1 = std::min(m, j0 + TILE_COLS) - 1;
+	return j0 <= Lo(i1) + band - 1 && j1 >= Lo(i0);
+}
+
+void BandedDtw::Tile(int64_t bi, int64_t bj, float* scratch) {
+	int64_t i1 = std::min(n, (bi + 1) * TILE_ROWS);
+	for (int64_t i = bi * TILE_ROWS; i < i1; ++i) {
+		int64_t j0 = std::max({ bj * TILE_COLS, Lo(i), (int64_t)0 });
+		int64_t j1 = std::min({ (bj + 1) * TILE_COLS, Lo(i) + band, m });
+		if (j0 < j1) ComputeRow(i, j0, j1, scratch);
+	}
+}
+
+void BandedDtw::ComputeRow(int64_t i, int64_t j0, int64_t j1, float* cost) {
+	float* cur = Row(i) + (1 - Lo(i));      // cur[j]: D[i][j]
+	const float* prev = i > 0 ? Row(i - 1) + (1 - Lo(i - 1)) : nullptr;
+	const float ax[4] = { a.axis[0][i], a.axis[1][i], a.axis[2][i], a.axis[3][i] };
+	const uint32_t ab = a.buttons[i];
+
+	// 1) 局所コストと、上・左上からの最小値 (列ごとに独立)
+	int64_t j = j0;
+#ifdef COMPARE_SSE2
+	if (prev) {
+		const __m128 w = _mm_set1_ps(buttonWeight);
+		const __m128i m1 = _mm_set1_epi32(0x55555555);
+		const __m128i m2 = _mm_set1_epi32(0x33333333);
+		const __m128i m4 = _mm_set1_epi32(0x0F0F0F0F);
+		const __m128i m6 = _mm_set1_epi32(0x3F);
+		const __m128i vb = _mm_set1_epi32((int)ab);
+		for (; j + 4 <= j1; j += 4) {
+			__m128 sum = _mm_setzero_ps();
+			for (int k = 0; k < 4; ++k) {
+				__m128 diff = _mm_sub_ps(_mm_set1_ps(ax[k]), _mm_loadu_ps(&b.axis[k][j]));
+				sum = _mm_add_ps(sum, _mm_mul_ps(diff, diff));
+			}
+			// popcount (SWAR)
+			__m128i x = _mm_xor_si128(vb, _mm_loadu_si128((const __m128i*)&b.buttons[j]));
+			x = _mm_sub_epi32(x, _mm_and_si128(_mm_srli_epi32(x, 1), m1));
+			x = _mm_add_epi32(_mm_and_si128(x, m2), _mm_and_si128(_mm_srli_epi32(x, 2), m2));
+			x = _mm_and_si128(_mm_add_epi32(x, _mm_srli_epi32(x, 4)), m4);
+			x = _mm_add_epi32(x, _mm_srli_epi32(x, 8));
+			x = _mm_and_si128(_mm_add_epi32(x, _mm_srli_epi32(x, 16)), m6);
+			__m128 c = _mm_add_ps(sum, _mm_mul_ps(w, _mm_cvtepi32_ps(x)));
+
+			__m128 best = _mm_min_ps(_mm_loadu_ps(prev + j), _mm_loadu_ps(prev + j - 1));
+			_mm_storeu_ps(cost + (j - j0), c);
+			_mm_storeu_ps(cur + j, _mm_add_ps(c, best));
+		}
+	}
+#endif
+	for (; j < j1; ++j) {
+		float c = 0;
+		for (int k = 0; k < 4; ++k) {
+			float diff = ax[k] - b.axis[k][j];
+			c += diff * diff;
+		}
+		uint32_t x = ab ^ b.buttons[j];
+		int bits = 0;
+		for (; x; x &= x - 1) ++bits;
+		c += buttonWeight * bits;
+
+		float best = prev ? std::min(prev[j], prev[j - 1]) : (j == 0 ? 0.0f : INF);
+		cost[j - j0] = c;
+		cur[j] = c + best;
+	}
+
+	// 2) 左からの依存だけ逐次に処理する (j0 の左は隣のタイルか番兵)
+	float left = cur[j0 - 1];
+	for (j = j0; j < j1; ++j) {
+		left = std::min(cur[j], cost[j - j0] + left);
+		cur[j] = left;
+	}
+}
+
+void BandedDtw::Run(int threads) {
+	const int64_t rowTiles = (n + TILE_ROWS - 1) / TILE_ROWS;
+	const int64_t colTiles = (m + TILE_COLS - 1) / TILE_COLS;
+
+	// 反対角線ごとのタイル一覧。同じ反対角線上のタイルは互いに依存しない
+	std::vector<std::pair<int64_t, int64_t>> tiles;
+	std::vector<size_t> diagonals{ 0 };
+	for (int64_t diag = 0; diag < rowTiles + colTiles - 1; ++diag) {
+		for (int64_t bi = std::max<int64_t>(0, diag - colTiles + 1); bi <= std::min(diag, rowTiles - 1); ++bi) {
+			if (TileActive(bi, diag - bi)) tiles.emplace_back(bi, diag - bi);
+		}
+		if (tiles.size() != diagonals.back()) diagonals.push_back(tiles.size());
+	}
+
+	std::vector<std::atomic<size_t>> next(diagonals.size());
+	for (size_t k = 0; k + 1 < diagonals.size(); ++k) next[k] = diagonals[k];
+	std::atomic<int> arrived{ 0 };
+	std::atomic<size_t> generation{ 0 };
+
+	auto worker = [&] {
+		std::vector<float> scratch(TILE_COLS);
+		for (size_t k = 0; k + 1 < diagonals.size(); ++k) {
+			for (size_t t; (t = next[k].fetch_add(1)) < diagonals[k + 1];) {
+				Tile(tiles[t].first, tiles[t].second, scratch.data());
+			}
+			// 反対角線ごとに全員の完了を待つ (タイルが小さいのでスピンで待つ)
+			if (arrived.fetch_add(1) + 1 == threads) {
+				arrived = 0;
+				generation.fetch_add(1);
+			}
+			else {
+				while (generation.load() == k) std::this_thread::yield();
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; ++t) pool.emplace_back(worker);
+	worker();
+	for (auto& t : pool) t.join();
+}
+
+std::vector<std::pair<int64_t, int64_t>> BandedDtw::Path() const {
+	std::vector<std::pair<int64_t, int64_t>> path;
+	int64_t i = n - 1;
+	int64_t j = m - 1;
+	path.emplace_back(i, j);
+	while (i > 0 || j > 0) {
+		float diag = At(i - 1, j - 1);
+		float up = At(i - 1, j);
+		float left = At(i, j - 1);
+		if (diag <= up && diag <= left) {
+			--i;
+			--j;
+		}
+		else if (up <= left) --i;
+		else --j;
+		path.emplace_back(i, j);
+	}
+	std::reverse(path.begin(), path.end());
+	return path;
+}
+
+// ====== 押下の比較 ======
+
+struct Press
+{
+	int64_t frame;
+	int bit;
+	bool used = false;
+};
+
+static std::vector<Press> find_presses(const Series& s) {
+	std::vector<Press> presses;
+	uint32_t prev = 0;
+	for (size_t f = 0; f < s.Size(); ++f) {
+		uint32_t rising = s.buttons[f] & ~prev;
+		for (int bit = 0; bit < 24; ++bit) {
+			if (rising & (1u << bit)) presses.push_back({ (int64_t)f, bit });
+		}
+		prev = s.buttons[f];
+	}
+	return presses;
+}
+
+static std::string format_time(double sec) {
+	char buf[32];
+	int m = (int)(sec / 60);
+	std::snprintf(buf, sizeof(buf), "%02d:%06.3f", m, sec - m * 60);
+	return buf;
+}
+
+int main(int argc, char** argv) {
+	Options opt;
+	if (!parse_options(argc, argv, opt)) {
+		usage();
+		return 1;
+	}
+	if (opt.threads <= 0) opt.threads = std::max(1u, std::thread::hardware_concurrency());
+
+	Series ref, att;
+	if (!load_series(opt.reference, opt.rate, ref) || !load_series(opt.attempt, opt.rate, att)) return 1;
+
+	// 長い方を行にする (帯の位置が1行で高々1列しか進まないようにするため)
+	const bool swapped = att.Size() > ref.Size();
+	const Series& rows = swapped ? att : ref;
+	const Series& cols = swapped ? ref : att;
+	const int64_t radius = std::max<int64_t>(1, (int64_t)(opt.band * opt.rate));
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::pair<int64_t, int64_t>> path;
+	float cost;
+	try {
+		BandedDtw dtw(rows, cols, radius, (float)opt.buttonWeight);
+		dtw.Run(opt.threads);
+		cost = dtw.Cost();
+		path = dtw.Path();
+	}
+	catch (const std::bad_alloc&) {
+		std::cerr << "Error: not enough memory for the band, try a smaller --band" << std::endl;
+		return 1;
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::printf("reference %zu frames, attempt %zu frames, band +-%.2f s, %d threads\n",
+		ref.Size(), att.Size(), opt.band, opt.threads);
+	if (!std::isfinite(cost)) {
+		std::printf("no alignment within the band, try a larger --band\n");
+		return 1;
+	}
+	std::printf("alignment cost %.1f (%.3f per frame), %.3f s\n\n", cost, cost / path.size(), elapsed);
+
+	// お手本の各フレームに対応する試行側の位置 (経路上の平均) を、前後 smooth 秒で平均する
+	const size_t n = ref.Size();
+	std::vector<double> sum(n, 0), count(n, 0);
+	for (const auto& [i, j] : path) {
+		int64_t r = swapped ? j : i;
+		int64_t t = swapped ? i : j;
+		sum[r] += t;
+		count[r] += 1;
+	}
+	std::vector<double> prefix(n + 1, 0);
+	for (size_t r = 0; r < n; ++r) prefix[r + 1] = prefix[r] + sum[r] / count[r];
+	const int64_t w = (int64_t)(opt.smooth * opt.rate);
+	auto expected = [&](int64_t r) {
+		// 端では偏らないよう左右対称に狭める
+		int64_t h = std::min<int64_t>({ w, r, (int64_t)n - 1 - r });
+		return (prefix[r + h + 1] - prefix[r - h]) / (2 * h + 1);
+	};
+
+	std::vector<Press> refPresses = find_presses(ref);
+	std::vector<Press> attPresses = find_presses(att);
+	const double tol = opt.tolerance * opt.rate;
+	const double frameMs = 1000.0 / opt.rate;
+	int onTime = 0, early = 0, late = 0, missed = 0, extra = 0;
+
+	std::printf("%-10s %-8s %-7s %s\n", "time", "button", "result", "offset");
+	for (const auto& p : refPresses) {
+		double e = expected(p.frame);
+		Press* best = nullptr;
+		for (auto& q : attPresses) {
+			if (q.used || q.bit != p.bit || std::abs(q.frame - e) > tol) continue;
+			if (!best || std::abs(q.frame - e) < std::abs(best->frame - e)) best = &q;
+		}
+
+		std::string when = format_time(p.frame / opt.rate);
+		if (!best) {
+			++missed;
+			std::printf("%-10s %-8s %-7s\n", when.c_str(), SwitchPro::BUTTON_NAMES[p.bit], "missed");
+			continue;
+		}
+		best->used = true;
+		double offset = (best->frame - e) * frameMs;
+		const char* result = "ok";
+		if (offset < -opt.okMs) {
+			result = "early";
+			++early;
+		}
+		else if (offset > opt.okMs) {
+			result = "late";
+			++late;
+		}
+		else {
+			++onTime;
+		}
+		if (opt.all || result[0] != 'o') {
+			std::printf("%-10s %-8s %-7s %+.0f ms\n", when.c_str(), SwitchPro::BUTTON_NAMES[p.bit], result, offset);
+		}
+	}
+	for (const auto& q : attPresses) {
+		if (q.used) continue;
+		++extra;
+		std::printf("%-10s %-8s %-7s (attempt time)\n", format_time(q.frame / opt.rate).c_str(), SwitchPro::BUTTON_NAMES[q.bit], "extra");
+	}
+
+	std::printf("\npresses %zu: on time %d, early %d, late %d, missed %d, extra %d\n",
+		refPresses.size(), onTime, early, late, missed, extra);
+	return 0;
+}
@@ -0,0 +1,398 @@
+﻿// wxWidgets なしで受信し、デコード済みの入力を時刻付きで標準出力または FIFO に流す
+// bot・ロガー・集計デーモンなど下流のツール向け
+//
+// 例: headless --port /dev/ttyUSB0 --format ndjson | jq .
+//     mkfifo /tmp/pad && headless --port auto --format binary --output /tmp/pad
+//     simulator --link /tmp/sim & headless --include-pty   (シミュレーターの pty も探す)
+//     headless --output /dev/null --record session.ivs     (MainFrame と同じセッションファイルに記録)
+//
+// binary: 先頭に StreamHeader (16 byte)、以降 Record (32 byte, リトルエンディアン) が続く
+// ndjson: 1行1サンプル {"seq":..,"t_us":..,"buttons":..,"lx":..,"ly":..,"rx":..,"ry":..,"raw":[..]}
+//         buttons は SwitchPro::ButtonMask のビット配置
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <charconv>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include "../Visualizer/SerialAnalizer.h"
+#include "../Visualizer/AutoConnector.h"
+#include "../Visualizer/RingBuffer.h"
+#include "../Visualizer/VirtualGamepad.h"
+#include "../Visualizer/SessionArchive.h"
+
+#pragma pack(push, 1)
+struct StreamHeader
+{
+	char magic[8];          // "IVSTRM01"
+	int64_t startEpochUs;   // t_us = 0 の時点の UNIX 時刻
+};
+
+struct Record
+{
+	int64_t timeUs;         // 推定取得時刻 (StreamHeader::startEpochUs からの経過)
+	uint32_t seq;
+	uint32_t buttons;
+	int16_t axis[4];        // LX, LY, RX, RY (ニュートラル補正・フィルタ後)
+	uint16_t raw[4];        // 生値 (12bit)
+};
+#pragma pack(pop)
+static_assert(sizeof(StreamHeader) == 16, "StreamHeader size");
+static_assert(sizeof(Record) == 32, "Record size");
+
+struct Options
+{
+	std::string port = "auto";
+	std::string format = "ndjson";
+	std::string output = "-";
+	int flushMs = 10;
+	size_t bufferKb = 1024;
+	double duration = 0;
+	bool uinput = false;
+	bool includePty = false; // auto で /dev/pts/N も探す (シミュレーター用)
+	std::string filter = "radial";
+	std::string record;      // 空なら記録しない
+	SerialTuning::Options tuning;
+};
+
+static std::atomic<bool> running{ true };
+
+static void on_signal(int) {
+	running = false;
+}
+
+static void usage() {
+	std::cerr <<
+		"usage: headless [options]\n"
+		"  --port PATH          serial port, or auto (auto)\n"
+		"  --include-pty        auto also probes pseudo terminals (for the simulator)\n"
+		"  --format F           binary | ndjson (ndjson)\n"
+		"  --output PATH        output file or FIFO, - for stdout (-)\n"
+		"  --flush-ms MS        flush interval (10)\n"
+		"  --buffer-kb KB       write buffer size (1024)\n"
+		"  --duration SEC       stop after SEC (forever)\n"
+		"  --record PATH        also record a session file (.ivs)\n"
+		"  --uinput             also expose the pad as a uinput gamepad (Linux)\n"
+		"  --filter NAME        stick filter preset (radial)\n"
+		"  --low-latency        low latency port settings\n"
+		"  --priority N         SCHED_FIFO priority of the reader thread (off)\n"
+		"  --cpu N              pin the reader thread to CPU N (off)\n"
+		"  --mlock              lock the process memory with mlockall (Linux)\n"
+		"filters:\n";
+	for (const auto& p : StickFilter::Presets()) {
+		std::cerr << "  " << std::left << std::setw(21) << p.name << p.label << "\n";
+	}
+}
+
+static bool parse_options(int argc, char** argv, Options& opt) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--low-latency") {
+			opt.tuning.lowLatency = true;
+			continue;
+		}
+		if (arg == "--mlock") {
+			opt.tuning.lockMemory = true;
+			continue;
+		}
+		if (arg == "--include-pty") {
+			opt.includePty = true;
+			continue;
+		}
+		if (arg == "--uinput") {
+			opt.uinput = true;
+			continue;
+		}
+		if (i + 1 >= argc) return false;
+		std::string val = argv[++i];
+
+		if (arg == "--port") opt.port = val;
+		else if (arg == "--format") opt.format = val;
+		else if (arg == "--output") opt.output = val;
+		else if (arg == "--flush-ms") opt.flushMs = std::stoi(val);
+		else if (arg == "--buffer-kb") opt.bufferKb = std::stoul(val);
+		else if (arg == "--duration") opt.duration = std::stod(val);
+		else if (arg == "--filter") opt.filter = val;
+		else if (arg == "--record") opt.record = val;
+		else if (arg == "--priority") opt.tuning.priority = std::stoi(val);
+		else if (arg == "--cpu") opt.tuning.cpu = std::stoi(val);
+		else return false;
+	}
+	return (opt.format == "binary" || opt.format == "ndjson") && opt.bufferKb > 0
+		&& StickFilter::MakePreset(opt.filter);
+}
+
+// ====== 出力 ======
+
+// 大きなバッファに溜めて、一杯になるか Flush されたときに1回の fwrite で書き出す
+class BufferedWriter
+{
+public:
+	BufferedWriter(FILE* fp, size_t capacity) : fp(fp), buf(capacity) {}
+
+	// 書き込み先が閉じられたら false
+	bool Write(const void* data, size_t size) {
+		if (used + size > buf.size() && !Flush()) return false;
+		if (size > buf.size()) return fwrite(data, 1, size, fp) == size;
+		std::memcpy(buf.data() + used, data, size);
+		used += size;
+		return true;
+	}
+
+	// 書き込み用の領域を直接取る (NDJSON の整形用)
+	char* Reserve(size_t size) {
+		if (used + size > buf.size() && !Flush()) return nullptr;
+		return buf.data() + used;
+	}
+	void Commit(size_t size) { used += size; }
+
+	bool Flush() {
+		if (used == 0) return true;
+		bool ok = fwrite(buf.data(), 1, used, fp) == used && fflush(fp) == 0;
+		used = 0;
+		return ok;
+	}
+
+	size_t Pending() const { return used; }
+
+private:
+	FILE* fp;
+	std::vector<char> buf;
+	size_t used = 0;
+};
+
+static char* put_int(char* p, int64_t v) {
+	return std::to_chars(p, p + 24, v).ptr;
+}
+
+static char* put_str(char* p, const char* s, size_t n) {
+	std::memcpy(p, s, n);
+	return p + n;
+}
+
+#define PUT_LITERAL(p, s) put_str(p, s, sizeof(s) - 1)
+
+static bool write_ndjson(BufferedWriter& out, const Record& r) {
+	char* begin = out.Reserve(256);
+	if (!begin) return false;
+	char* p = begin;
+	p = PUT_LITERAL(p, "{\"seq\":");
+	p = put_int(p, r.seq);
+	p = PUT_LITERAL(p, ",\"t_us\":");
+	p = put_int(p, r.timeUs);
+	p = PUT_LITERAL(p, ",\"buttons\":");
+	p = put_int(p, r.buttons);
+	p = PUT_LITERAL(p, ",\"lx\":");
+	p = put_int(p, r.axis[0]);
+	p = PUT_LITERAL(p, ",\"ly\":");
+	p = put_int(p, r.axis[1]);
+	p = PUT_LITERAL(p, ",\"rx\":");
+	p = put_int(p, r.axis[2]);
+	p = PUT_LITERAL(p, ",\"ry\":");
+	p = put_int(p, r.axis[3]);
+	p = PUT_LITERAL(p, ",\"raw\":[");
+	for (int a = 0; a < 4; ++a) {
+		if (a) *p++ = ',';
+		p = put_int(p, r.raw[a]);
+	}
+	p = PUT_LITERAL(p, "]}\n");
+	out.Commit(p - begin);
+	return true;
+}
+
+// ====== 受信 ======
+
+// 読み込みスレッドでは Record に詰めてキューに積むだけ
+class RecordQueue : public SampleSink
+{
+public:
+	void OnSample(const GamePadSample& sample) override {
+		if (!started) {
+			origin = sample.captured;
+			originEpochUs = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::system_clock::now().time_since_epoch()
+				- (std::chrono::steady_clock::now() - sample.captured)).count();
+			started = true;
+		}
+		Record r;
+		r.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(sample.captured - origin).count();
+		r.seq = (uint32_t)sample.seq;
+		r.buttons = SwitchPro::ButtonMask(sample.pad);
+		r.axis[0] = sample.pad.LX;
+		r.axis[1] = sample.pad.LY;
+		r.axis[2] = sample.pad.RX;
+		r.axis[3] = sample.pad.RY;
+		std::copy(sample.raw, sample.raw + 4, r.raw);
+		if (!ring.Push(r)) ++dropped;
+		else if (!ready.load(std::memory_order_relaxed)) ready = true;
+	}
+
+	bool Pop(Record& r) { return ring.Pop(r); }
+
+	// 最初のサンプルを受け取るまで false
+	std::atomic<bool> ready{ false };
+	int64_t originEpochUs = 0;
+	std::atomic<uint64_t> dropped{ 0 };
+
+private:
+	SpscRing<Record, 16384> ring;
+	bool started = false;
+	std::chrono::steady_clock::time_point origin;
+};
+
+static SerialAnalizer* connect(const Options& opt) {
+	if (opt.port != "auto") {
+		try {
+			return new SerialAnalizer(opt.port, opt.tuning);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Error: " << e.what() << std::endl;
+			return nullptr;
+		}
+	}
+
+	std::mutex mtx;
+	std::condition_variable cv;
+	SerialAnalizer* serial = nullptr;
+	AutoConnector connector([&](SerialAnalizer* s) {
+		std::lock_guard<std::mutex> lock(mtx);
+		serial = s;
+		cv.notify_one();
+	}, opt.tuning, opt.includePty);
+
+	std::unique_lock<std::mutex> lock(mtx);
+	while (!serial && running) cv.wait_for(lock, std::chrono::milliseconds(100));
+	return serial;
+}
+
+int main(int argc, char** argv) {
+	Options opt;
+	if (!parse_options(argc, argv, opt)) {
+		usage();
+		return 1;
+	}
+
+	std::signal(SIGINT, on_signal);
+	std::signal(SIGTERM, on_signal);
+#ifndef _WIN32
+	// 読み手がいなくなったら書き込みエラーで終わる
+	std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+	// SerialAnalizer のログが標準出力のデータに混ざらないよう stderr に回す
+	std::cout.rdbuf(std::cerr.rdbuf());
+
+	FILE* fp = stdout;
+	if (opt.output != "-") {
+		// FIFO は読み手が開くまでここで待つ
+		fp = fopen(opt.output.c_str(), "wb");
+		if (!fp) {
+			std::cerr << "Error: cannot open " << opt.output << std::endl;
+			return 1;
+		}
+	}
+#ifdef _WIN32
+	else {
+		_setmode(_fileno(stdout), _O_BINARY);
+	}
+#endif
+	// バッファリングは BufferedWriter で行う
+	setvbuf(fp, nullptr, _IONBF, 0);
+	BufferedWriter out(fp, opt.bufferKb * 1024);
+
+	SerialAnalizer* serial = connect(opt);
+	if (!serial) return 1;
+	serial->SetStickFilter(*StickFilter::MakePreset(opt.filter));
+
+	RecordQueue queue;
+	serial->AddSink(&queue);
+
+	VirtualGamepad pad;
+	if (opt.uinput) {
+		if (!pad.Open()) {
+			delete serial;
+			return 1;
+		}
+		std::cerr << "uinput device: " << pad.DevicePath() << std::endl;
+		serial->AddSink(&pad);
+	}
+
+	SessionArchive::Writer recorder;
+	if (!opt.record.empty()) {
+		if (!recorder.Open(opt.record)) {
+			std::cerr << "Error: cannot create " << opt.record << std::endl;
+			delete serial;
+			return 1;
+		}
+		serial->AddSink(&recorder);
+	}
+
+	const bool binary = opt.format == "binary";
+	bool headerWritten = false;
+	uint64_t written = 0;
+	bool ok = true;
+
+	const auto flushInterval = std::chrono::milliseconds(std::max(opt.flushMs, 1));
+	const auto start = std::chrono::steady_clock::now();
+	auto nextFlush = start + flushInterval;
+
+	while (running && ok && serial->IsRunning() && !recorder.Failed()) {
+		std::this_thread::sleep_until(nextFlush);
+		nextFlush += flushInterval;
+		auto now = std::chrono::steady_clock::now();
+		if (nextFlush < now) nextFlush = now + flushInterval;
+
+		if (opt.duration > 0 && now - start >= std::chrono::duration<double>(opt.duration)) break;
+		if (!queue.ready) continue;
+		if (binary && !headerWritten) {
+			StreamHeader header;
+			std::memcpy(header.magic, "IVSTRM01", 8);
+			header.startEpochUs = queue.originEpochUs;
+			ok = out.Write(&header, sizeof(header));
+			headerWritten = true;
+		}
+
+		// 溜まった分をまとめて整形し、1回で書き出す
+		Record r;
+		while (ok && queue.Pop(r)) {
+			ok = binary ? out.Write(&r, sizeof(r)) : write_ndjson(out, r);
+			++written;
+		}
+		if (ok) ok = out.Flush();
+	}
+
+	serial->RemoveSink(&queue);
+	if (pad.IsOpen()) {
+		serial->RemoveSink(&pad);
+		const LatencyStats& l = pad.Latency();
+		std::cerr << "uinput latency p50 " << l.Percentile(0.5) << " us, p99 " << l.Percentile(0.99)
+			<< " us, max " << l.Max() << " us" << std::endl;
+	}
+	if (ok) out.Flush();
+	if (fp != stdout) fclose(fp);
+
+	std::cerr << "written " << written << " samples, dropped " << queue.dropped << std::endl;
+	bool recordFailed = false;
+	if (recorder.IsOpen()) {
+		serial->RemoveSink(&recorder);
+		recorder.Close();
+		recordFailed = recorder.Failed();
+		if (recordFailed) std::cerr << "Error: failed to write " << opt.record << ", the session is incomplete" << std::endl;
+		std::cerr << "recorded " << recorder.Written() << " samples, dropped " << recorder.Dropped() << std::endl;
+	}
+	bool stopped = !serial->IsRunning();
+	delete serial;
+	if (stopped) return 2;
+	return recordFailed ? 1 : 0;
+}
@@ -0,0 +1,367 @@
+﻿// usb.ino と同じプロトコル (0xAA, 長さ, レポート, 0xBB) を疑似端末に流すシミュレータ
+// 実機なしで SerialAnalizer / MainFrame / DrawPanel の負荷試験・長時間試験を行う (Linuxのみ)
+//
+// 例: simulator --ports 4 --rate 1000 --pattern random --corrupt 0.001 --stall-every 30 --link /tmp/ivsim
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cstring>
+#include <csignal>
+#include <ctime>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+struct Options
+{
+	int ports = 1;
+	double rate = 125;            // レポート/秒
+	std::string pattern = "random"; // random, sweep, idle, script
+	std::string script;
+	double tick_us = 0;           // タイマー1tickの長さ (0ならレポート周期)
+	double corrupt = 0;           // フレームを壊す確率
+	double burst_every = 0;       // 秒。送信を溜めてまとめて送る間隔
+	int burst_len = 16;           // まとめて送るフレーム数
+	double stall_every = 0;       // 秒。送信を止める間隔
+	double stall_ms = 200;        // 止める長さ
+	double duration = 0;          // 秒 (0なら無制限)
+	std::string link;             // シンボリックリンクの接頭辞
+	unsigned seed = 1;
+};
+
+// スクリプトの1行: 継続時間(ms) ボタン(16進24bit) LX LY RX RY (各 0～4095)
+struct ScriptStep
+{
+	double ms;
+	uint32_t buttons;
+	uint16_t stick[4];
+};
+
+struct Stats
+{
+	std::atomic<uint64_t> sent{ 0 };
+	std::atomic<uint64_t> dropped{ 0 };   // 疑似端末のバッファが一杯で送れなかった
+	std::atomic<uint64_t> corrupted{ 0 };
+};
+
+static std::atomic<bool> running{ true };
+
+static void on_signal(int) {
+	running = false;
+}
+
+static void usage() {
+	std::cerr <<
+		"usage: simulator [options]\n"
+		"  --ports N            number of virtual ports (1)\n"
+		"  --rate HZ            reports per second per port (125)\n"
+		"  --pattern P          random | sweep | idle | script:FILE (random)\n"
+		"  --tick-us US         report timer tick length (1/rate)\n"
+		"  --corrupt P          probability of corrupting a frame (0)\n"
+		"  --burst-every SEC    queue frames and send them at once every SEC (off)\n"
+		"  --burst-len N        frames per burst (16)\n"
+		"  --stall-every SEC    stop sending every SEC (off)\n"
+		"  --stall-ms MS        stall length (200)\n"
+		"  --duration SEC       stop after SEC (forever)\n"
+		"  --link PREFIX        create PREFIX0, PREFIX1, ... symlinks to the ptys\n"
+		"  --seed N             random seed (1)\n";
+}
+
+static bool parse_options(int argc, char** argv, Options& opt) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) return false;
+		std::string val = argv[++i];
+
+		if (arg == "--ports") opt.ports = std::stoi(val);
+		else if (arg == "--rate") opt.rate = std::stod(val);
+		else if (arg == "--pattern") {
+			if (val.rfind("script:", 0) == 0) {
+				opt.pattern = "script";
+				opt.script = val.substr(7);
+			}
+			else opt.pattern = val;
+		}
+		else if (arg == "--tick-us") opt.tick_us = std::stod(val);
+		else if (arg == "--corrupt") opt.corrupt = std::stod(val);
+		else if (arg == "--burst-every") opt.burst_every = std::stod(val);
+		else if (arg == "--burst-len") opt.burst_len = std::stoi(val);
+		else if (arg == "--stall-every") opt.stall_every = std::stod(val);
+		else if (arg == "--stall-ms") opt.stall_ms = std::stod(val);
+		else if (arg == "--duration") opt.duration = std::stod(val);
+		else if (arg == "--link") opt.link = val;
+		else if (arg == "--seed") opt.seed = std::stoul(val);
+		else return false;
+	}
+	return opt.ports > 0 && opt.rate > 0;
+}
+
+static std::vector<ScriptStep> load_script(const std::string& path) {
+	std::vector<ScriptStep> steps;
+	std::ifstream ifs(path);
+	std::string line;
+	while (std::getline(ifs, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream iss(line);
+		ScriptStep s;
+		iss >> s.ms >> std::hex >> s.buttons >> std::dec >> s.stick[0] >> s.stick[1] >> s.stick[2] >> s.stick[3];
+		if (iss) steps.push_back(s);
+	}
+	return steps;
+}
+
+// 入力パターン生成
+class Pattern
+{
+public:
+	Pattern(const Options& opt, const std::vector<ScriptStep>& script, unsigned seed)
+		: opt(opt), script(script), rng(seed) {
+		for (auto& s : stick) s = 2048;
+	}
+
+	void Next(double t, uint32_t& buttons, uint16_t out[4]) {
+		if (opt.pattern == "sweep") {
+			// スティックは1Hzで円を描き、ボタンは250msごとに1つずつ押す
+			double a = 2 * M_PI * t;
+			stick[0] = (uint16_t)(2048 + 1400 * cos(a));
+			stick[1] = (uint16_t)(2048 + 1400 * sin(a));
+			stick[2] = (uint16_t)(2048 + 1400 * cos(-a));
+			stick[3] = (uint16_t)(2048 + 1400 * sin(-a));
+			static const uint32_t masks[] = {
+				0x000008, 0x000004, 0x000002, 0x000001, 0x000040, 0x000080, // A B X Y R ZR
+				0x000100, 0x000200, 0x000400, 0x000800,                     // - + R3 L3
+				0x010000, 0x020000, 0x040000, 0x080000, 0x400000, 0x800000, // 十字キー L ZL
+			};
+			buttons = masks[(int)(t * 4) % 16];
+		}
+		else if (opt.pattern == "script" && !script.empty()) {
+			double ms = fmod(t * 1000, total_ms());
+			size_t i = 0;
+			while (i + 1 < script.size() && ms >= script[i].ms) {
+				ms -= script[i].ms;
+				++i;
+			}
+			buttons = script[i].buttons;
+			for (int k = 0; k < 4; ++k) stick[k] = script[i].stick[k];
+		}
+		else if (opt.pattern == "random") {
+			// スティックはランダムウォーク、ボタンは時々反転
+			std::normal_distribution<double> step(0, 40);
+			for (auto& s : stick) {
+				s = (uint16_t)std::clamp(s + step(rng), 300.0, 3800.0);
+			}
+			std::uniform_int_distribution<int> bit(0, 23);
+			if (std::uniform_real_distribution<double>(0, 1)(rng) < 0.05) {
+				random_buttons ^= 1u << bit(rng);
+				random_buttons &= 0xCF3FCF;  // 未使用ビットは立てない
+			}
+			buttons = random_buttons;
+		}
+		else {
+			buttons = 0;
+		}
+		for (int k = 0; k < 4; ++k) out[k] = stick[k];
+	}
+
+private:
+	double total_ms() const {
+		double sum = 0;
+		for (const auto& s : script) sum += s.ms;
+		return sum > 0 ? sum : 1;
+	}
+
+	const Options& opt;
+	const std::vector<ScriptStep>& script;
+	std::mt19937 rng;
+	double stick[4];
+	uint32_t random_buttons = 0;
+};
+
+// フレーム (16バイト) を組み立てる
+static size_t build_frame(uint8_t* out, uint8_t timer, uint32_t buttons, const uint16_t stick[4]) {
+	uint8_t* p = out;
+	*p++ = 0xAA;
+	*p++ = 13;
+	*p++ = 0x30;   // report id
+	*p++ = timer;
+	*p++ = 0x8E;   // 接続情報・バッテリー
+	*p++ = buttons & 0xFF;
+	*p++ = (buttons >> 8) & 0xFF;
+	*p++ = (buttons >> 16) & 0xFF;
+	*p++ = stick[0] & 0xFF;
+	*p++ = ((stick[0] >> 8) & 0x0F) | ((stick[1] & 0x0F) << 4);
+	*p++ = stick[1] >> 4;
+	*p++ = stick[2] & 0xFF;
+	*p++ = ((stick[2] >> 8) & 0x0F) | ((stick[3] & 0x0F) << 4);
+	*p++ = stick[3] >> 4;
+	*p++ = 0x00;   // vibrator
+	*p++ = 0xBB;
+	return p - out;
+}
+
+static void add_ns(timespec& ts, long long ns) {
+	ts.tv_nsec += ns;
+	while (ts.tv_nsec >= 1000000000) {
+		ts.tv_nsec -= 1000000000;
+		++ts.tv_sec;
+	}
+}
+
+static double elapsed_sec(const timespec& from, const timespec& to) {
+	return (to.tv_sec - from.tv_sec) + (to.tv_nsec - from.tv_nsec) * 1e-9;
+}
+
+static void run_port(int master, const Options& opt, const std::vector<ScriptStep>& script, unsigned seed, Stats& stats) {
+	Pattern pattern(opt, script, seed);
+	std::mt19937 rng(seed ^ 0x9E3779B9u);
+	std::uniform_real_distribution<double> uni(0, 1);
+
+	const long long period_ns = (long long)(1e9 / opt.rate);
+	const double tick_us = opt.tick_us > 0 ? opt.tick_us : 1e6 / opt.rate;
+
+	std::vector<uint8_t> pending;
+	size_t carry = 0; // pending 先頭の、前回書きかけたフレームの残り
+	int burst_left = 0;
+	double next_burst = opt.burst_every;
+	double next_stall = opt.stall_every;
+	double stall_until = 0;
+
+	timespec start, next;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = start;
+
+	while (running) {
+		add_ns(next, period_ns);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+
+		double t = elapsed_sec(start, next);
+		if (opt.duration > 0 && t >= opt.duration) break;
+
+		// 送信停止 (タイマーは進み続ける)
+		if (opt.stall_every > 0 && t >= next_stall) {
+			stall_until = t + opt.stall_ms / 1000;
+			next_stall += opt.stall_every;
+		}
+		if (t < stall_until) continue;
+
+		uint32_t buttons;
+		uint16_t stick[4];
+		pattern.Next(t, buttons, stick);
+
+		uint8_t frame[32];
+		size_t len = build_frame(frame, (uint8_t)(uint64_t)(t * 1e6 / tick_us), buttons, stick);
+
+		if (opt.corrupt > 0 && uni(rng) < opt.corrupt) {
+			// 長さ・終了バイト・中身のどれかを壊す
+			frame[1 + (size_t)(uni(rng) * (len - 1))] ^= 0x5A;
+			++stats.corrupted;
+		}
+
+		if (opt.burst_every > 0 && t >= next_burst) {
+			burst_left = opt.burst_len;
+			next_burst += opt.burst_every;
+		}
+		pending.insert(pending.end(), frame, frame + len);
+		if (burst_left > 0 && --burst_left > 0) continue;
+
+		// 書ききれなかった分はフレーム単位で捨てる
+		// 書きかけのフレームだけは残りを次回送り、受信側のフレーム境界を崩さない
+		ssize_t n = write(master, pending.data(), pending.size());
+		size_t written = n > 0 ? (size_t)n : 0;
+		size_t frames = (pending.size() - carry) / len;
+		size_t done = written > carry ? written - carry : 0;
+		size_t started = (done + len - 1) / len;
+		stats.sent += started;
+		stats.dropped += frames - started;
+		size_t keep = written < carry ? carry - written : (len - done % len) % len;
+		pending.erase(pending.begin(), pending.begin() + written);
+		pending.resize(keep);
+		carry = keep;
+	}
+}
+
+int main(int argc, char** argv) {
+	Options opt;
+	if (!parse_options(argc, argv, opt)) {
+		usage();
+		return 1;
+	}
+
+	std::vector<ScriptStep> script;
+	if (opt.pattern == "script") {
+		script = load_script(opt.script);
+		if (script.empty()) {
+			std::cerr << "Error: empty script " << opt.script << std::endl;
+			return 1;
+		}
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	std::vector<int> masters;
+	std::vector<int> slaves;
+	std::vector<std::string> links;
+
+	for (int i = 0; i < opt.ports; ++i) {
+		int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+		if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+			std::cerr << "Error: posix_openpt: " << strerror(errno) << std::endl;
+			return 1;
+		}
+		std::string name = ptsname(master);
+
+		// スレーブ側を raw にして開いたままにする (改行変換などを止め、読み手が閉じても EIO にしない)
+		int slave = open(name.c_str(), O_RDWR | O_NOCTTY);
+		termios tio;
+		if (slave >= 0 && tcgetattr(slave, &tio) == 0) {
+			cfmakeraw(&tio);
+			tcsetattr(slave, TCSANOW, &tio);
+		}
+
+		if (!opt.link.empty()) {
+			std::string link = opt.link + std::to_string(i);
+			unlink(link.c_str());
+			if (symlink(name.c_str(), link.c_str()) == 0) links.push_back(link);
+		}
+
+		masters.push_back(master);
+		slaves.push_back(slave);
+		std::cout << name << std::endl;
+	}
+
+	std::vector<Stats> stats(opt.ports);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < opt.ports; ++i) {
+		threads.emplace_back(run_port, masters[i], std::cref(opt), std::cref(script), opt.seed + i, std::ref(stats[i]));
+	}
+
+	// 1秒ごとに送信状況を表示する
+	int seconds = 0;
+	while (running) {
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		uint64_t sent = 0, dropped = 0, corrupted = 0;
+		for (auto& s : stats) {
+			sent += s.sent;
+			dropped += s.dropped;
+			corrupted += s.corrupted;
+		}
+		std::cerr << "sent " << sent << " dropped " << dropped << " corrupted " << corrupted << std::endl;
+
+		if (opt.duration > 0 && ++seconds > opt.duration) running = false;
+	}
+
+	for (auto& t : threads) t.join();
+	for (auto& l : links) unlink(l.c_str());
+	for (int fd : slaves) if (fd >= 0) close(fd);
+	for (int fd : masters) close(fd);
+	return 0;
+}